@@ -1,9 +1,11 @@
-cp -f main.c lcdaemon.c fakeleds.c settings.txt main.ttf ../../trimui-smart-pro-toolchain/workspace/
-docker exec -it trimui gcc -o fakeleds fakeleds.c -lSDL2 -lm
-docker exec -it trimui  gcc -o main main.c -lSDL2 -lSDL2_ttf -lm
-docker exec -it trimui gcc -o lcdaemon lcdaemon.c -lSDL2 -lm
+cp -f main.c lcdaemon.c lcbench.c fakeleds.c ledctl.c ledshm.h lcctl.h settings.txt main.ttf ../../trimui-smart-pro-toolchain/workspace/
+docker exec -it trimui gcc -o fakeleds fakeleds.c -lm
+docker exec -it trimui  gcc -o main main.c -lSDL2 -lSDL2_ttf -lm -lrt
+docker exec -it trimui gcc -DLCDAEMON_AUDIO -o lcdaemon lcdaemon.c -lSDL2 -lm -lrt -lfftw3f -lasound -lpthread
+docker exec -it trimui gcc -o ledctl ledctl.c
+docker exec -it trimui gcc -DLCDAEMON_AUDIO -O2 -o lcbench lcbench.c -lSDL2 -lm -lrt -ldl -lfftw3f -lasound -lpthread
 
-mv -f ../../trimui-smart-pro-toolchain/workspace/fakeleds ../../trimui-smart-pro-toolchain/workspace/main ../../trimui-smart-pro-toolchain/workspace/lcdaemon ./build/
+mv -f ../../trimui-smart-pro-toolchain/workspace/fakeleds ../../trimui-smart-pro-toolchain/workspace/main ../../trimui-smart-pro-toolchain/workspace/lcdaemon ../../trimui-smart-pro-toolchain/workspace/ledctl ../../trimui-smart-pro-toolchain/workspace/lcbench ./build/
 cp -f main.ttf colors.txt ./build/
 cp -f settings.txt /etc/LedControl/
 cp -f settings.txt ./build/
\ No newline at end of file
@@ -1,36 +1,375 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <math.h>
+#include <time.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
 
-// Function to print a character in the given RGB color
-void print_color_char(char r, char g, char b, char c)
+// LED simulator for developing lcdaemon on a PC.
+// Creates a fake led_anim directory on tmpfs with the attributes of the TrimUI LED driver, watches them
+// with inotify and draws the 23 LEDs in the terminal (24-bit colors), emulating the native effects 1 to 7.
+//
+//   ./fakeleds [directory]      (default: /dev/shm/fake_led_anim)
+//
+// Then point lcdaemon at it:
+//   ./lcdaemon --led-anim /dev/shm/fake_led_anim
+
+#define DEFAULT_DIR "/dev/shm/fake_led_anim"
+#define LED_COUNT 23
+#define FRAME_MS 16      // Redraw rate while a native effect animates
+#define STATS_MS 1000    // Attribute writes are counted over this period
+#define MAX_SCALE_FULL 100
+
+typedef struct
+{
+    const char *name;
+    int first_led;
+    int led_count;
+    uint32_t color; // effect_rgb_hex_<name>
+    int effect;     // effect_<name>, 0: LEDs show frame_hex
+    int duration;   // effect_duration_<name>, ms per cycle
+    int cycles;     // effect_cycles_<name>, -1: forever
+    long started_ms;
+    uint32_t from_color; // Linear: color shown when effect_rgb_hex was written
+} FakeLight;
+
+FakeLight fake_lights[] = {
+    {"m", 0, 1, 0, 0, 1000, -1, 0},
+    {"lr", 1, LED_COUNT - 1, 0, 0, 1000, -1, 0},
+};
+#define NUM_FAKE_LIGHTS (int)(sizeof(fake_lights) / sizeof(fake_lights[0]))
+
+uint32_t frame[LED_COUNT]; // frame_hex
+int max_scale = MAX_SCALE_FULL;
+int writes = 0;
+int writes_per_second = 0;
+volatile sig_atomic_t running = 1;
+
+void handle_signal(int sig)
+{
+    running = 0;
+}
+
+long now_ms()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+void create_attr(const char *dir, const char *attr, const char *value)
 {
-    printf("\033[38;2;%d;%d;%dm%c\033[0m", r, g, b, c);
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), "%s/%s", dir, attr);
+    FILE *file = fopen(filepath, "w");
+    if (file != NULL)
+    {
+        fputs(value, file);
+        fclose(file);
+    }
+    chmod(filepath, 0666);
 }
 
-int main()
+// Same attributes as the real driver, with its power-on values
+int create_led_anim(const char *dir)
 {
-    while (1)
+    if (mkdir(dir, 0777) != 0 && errno != EEXIST)
+    {
+        perror("Unable to create the fake led_anim directory");
+        return -1;
+    }
+
+    char frame_hex[LED_COUNT * 7 + 1] = "";
+    for (int i = 0; i < LED_COUNT; i++)
+        strcat(frame_hex, "000000 ");
+    create_attr(dir, "frame_hex", frame_hex);
+    create_attr(dir, "max_scale", "100\n");
+    create_attr(dir, "help", "Fake TrimUI LED animation driver (fakeleds)\n");
+
+    for (int i = 0; i < NUM_FAKE_LIGHTS; i++)
     {
-        FILE *file = fopen("colors.txt", "r");
-        if (file == NULL)
+        char attr[64];
+        snprintf(attr, sizeof(attr), "effect_rgb_hex_%s", fake_lights[i].name);
+        create_attr(dir, attr, "000000\n");
+        snprintf(attr, sizeof(attr), "effect_%s", fake_lights[i].name);
+        create_attr(dir, attr, "0\n");
+        snprintf(attr, sizeof(attr), "effect_duration_%s", fake_lights[i].name);
+        create_attr(dir, attr, "1000\n");
+        snprintf(attr, sizeof(attr), "effect_cycles_%s", fake_lights[i].name);
+        create_attr(dir, attr, "-1\n");
+    }
+    return 0;
+}
+
+uint32_t effect_color(const FakeLight *light, long now);
+
+// Applies an attribute which was just written
+void read_attr(const char *dir, const char *attr)
+{
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), "%s/%s", dir, attr);
+    int fd = open(filepath, O_RDONLY);
+    if (fd < 0)
+        return;
+    char buffer[LED_COUNT * 7 + 64];
+    int len = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (len <= 0)
+        return;
+    buffer[len] = '\0';
+    writes++;
+
+    if (strcmp(attr, "frame_hex") == 0)
+    {
+        char *next = buffer;
+        for (int i = 0; i < LED_COUNT; i++)
         {
-            perror("Failed to open file");
-            return 1;
+            char *end;
+            uint32_t color = strtoul(next, &end, 16);
+            if (end == next)
+                break;
+            frame[i] = color;
+            next = end;
         }
+        return;
+    }
+    if (strcmp(attr, "max_scale") == 0)
+    {
+        max_scale = atoi(buffer);
+        return;
+    }
 
-        char hex[7]; // Buffer to store hex color (6 characters + null terminator)
-        while (fscanf(file, "%6s", hex) == 1)
+    for (int i = 0; i < NUM_FAKE_LIGHTS; i++)
+    {
+        FakeLight *light = &fake_lights[i];
+        const char *suffix = strrchr(attr, '_');
+        if (suffix == NULL || strcmp(suffix + 1, light->name) != 0)
+            continue;
+
+        int prefix_len = suffix - attr;
+        // Like the driver, writing any effect attribute restarts the animation
+        if (strncmp(attr, "effect_rgb_hex", prefix_len) == 0 && prefix_len == 14)
         {
-            // Convert hex to RGB
-            int r, g, b;
-            sscanf(hex, "%02x%02x%02x", &r, &g, &b);
+            light->from_color = light->effect > 0 ? effect_color(light, now_ms()) : frame[light->first_led];
+            light->color = strtoul(buffer, NULL, 16);
+        }
+        else if (strncmp(attr, "effect_duration", prefix_len) == 0 && prefix_len == 15)
+            light->duration = atoi(buffer);
+        else if (strncmp(attr, "effect_cycles", prefix_len) == 0 && prefix_len == 13)
+            light->cycles = atoi(buffer);
+        else if (strncmp(attr, "effect", prefix_len) == 0 && prefix_len == 6)
+            light->effect = atoi(buffer);
+        else
+            return;
+        light->started_ms = now_ms();
+    }
+}
 
-            // Print a character ('#') in the corresponding color
-            print_color_char(r, g, b, '#');
+// Intensity of a native effect (1-7) at a given time, from 0 to 1
+float native_effect_level(const FakeLight *light, long now)
+{
+    int period = light->duration > 0 ? light->duration : 1;
+    long elapsed = now - light->started_ms;
+    if (light->cycles > 0 && elapsed >= (long)light->cycles * period)
+        return 0.0f; // All cycles played
+
+    float phase = (float)(elapsed % period) / period;
+    switch (light->effect)
+    {
+    case 2: // Breathe
+        return 0.5f - 0.5f * cosf(2.0f * (float)M_PI * phase);
+    case 3: // Interval Breathe: one breath, then a pause as long
+        return phase < 0.5f ? 0.5f - 0.5f * cosf(4.0f * (float)M_PI * phase) : 0.0f;
+    case 5: // Blink 1
+        return phase < 0.5f ? 1.0f : 0.0f;
+    case 6: // Blink 2
+        return (phase < 0.1f || (phase >= 0.2f && phase < 0.3f)) ? 1.0f : 0.0f;
+    case 7: // Blink 3
+        return (phase < 0.1f || (phase >= 0.2f && phase < 0.3f) || (phase >= 0.4f && phase < 0.5f)) ? 1.0f : 0.0f;
+    default: // 4 Static
+        return 1.0f;
+    }
+}
+
+// Unscaled color of a light showing a native effect
+uint32_t effect_color(const FakeLight *light, long now)
+{
+    float level = native_effect_level(light, now);
+    float from = 0.0f;
+    if (light->effect == 1)
+    {
+        // Linear: from the color shown before to the new one over the duration, then holds it
+        long elapsed = now - light->started_ms;
+        from = light->duration > 0 && elapsed < light->duration ? 1.0f - (float)elapsed / light->duration : 0.0f;
+        level = 1.0f - from;
+    }
+
+    uint32_t color = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        int channel = ((light->from_color >> shift) & 0xFF) * from + ((light->color >> shift) & 0xFF) * level;
+        color |= (uint32_t)channel << shift;
+    }
+    return color;
+}
+
+bool animating(long now)
+{
+    for (int i = 0; i < NUM_FAKE_LIGHTS; i++)
+    {
+        int effect = fake_lights[i].effect;
+        if (effect == 2 || effect == 3 || effect >= 5)
+            return true;
+        if (effect == 1 && now - fake_lights[i].started_ms < fake_lights[i].duration)
+            return true;
+    }
+    return false;
+}
+
+// What the LEDs show now: frame_hex for lights without effect, the emulated effect otherwise
+void compose_leds(uint32_t *leds, long now)
+{
+    float scale = (max_scale < 0 ? 0 : max_scale > MAX_SCALE_FULL ? MAX_SCALE_FULL : max_scale) / (float)MAX_SCALE_FULL;
+    for (int i = 0; i < NUM_FAKE_LIGHTS; i++)
+    {
+        const FakeLight *light = &fake_lights[i];
+        uint32_t shown = light->effect > 0 ? effect_color(light, now) : 0;
+        for (int j = light->first_led; j < light->first_led + light->led_count; j++)
+        {
+            uint32_t color = light->effect > 0 ? shown : frame[j];
+            int r = ((color >> 16) & 0xFF) * scale;
+            int g = ((color >> 8) & 0xFF) * scale;
+            int b = (color & 0xFF) * scale;
+            leds[j] = (r << 16) | (g << 8) | b;
         }
-        printf("\n");
-        fclose(file);
     }
+}
+
+// Centre light between the two stick rings. Per ring, LEDs 1-3 are on the left, 4-5 at the bottom,
+// 6-8 on the right and 9-11 at the top (12-22 for the right ring).
+#define GRID_W 52
+#define GRID_H 11
+
+void draw_leds(const uint32_t *leds)
+{
+    int grid[GRID_H][GRID_W];
+    for (int y = 0; y < GRID_H; y++)
+        for (int x = 0; x < GRID_W; x++)
+            grid[y][x] = -1;
+
+    int center_y = GRID_H / 2;
+    grid[center_y][GRID_W / 2] = 0;
+    grid[center_y][GRID_W / 2 - 1] = 0;
+    for (int k = 1; k <= 11; k++)
+    {
+        float angle = (180.0f + (k - 2) * 360.0f / 11) * (float)M_PI / 180.0f;
+        int dx = (int)lroundf(9.0f * cosf(angle)); // Terminal cells are about twice as high as wide
+        int dy = (int)lroundf(-4.5f * sinf(angle));
+        grid[center_y + dy][12 + dx] = k;
+        grid[center_y + dy][GRID_W - 13 + dx] = k + 11;
+    }
+
+    printf("\033[H");
+    for (int y = 0; y < GRID_H; y++)
+    {
+        for (int x = 0; x < GRID_W; x++)
+        {
+            if (grid[y][x] < 0)
+            {
+                putchar(' ');
+                continue;
+            }
+            uint32_t color = leds[grid[y][x]];
+            if (color == 0)
+                printf("\033[38;2;60;60;60m○\033[0m"); // LED off
+            else
+                printf("\033[38;2;%d;%d;%dm●\033[0m", (color >> 16) & 0xFF, (color >> 8) & 0xFF, color & 0xFF);
+        }
+        printf("\033[K\n");
+    }
+
+    for (int i = 0; i < NUM_FAKE_LIGHTS; i++)
+    {
+        const FakeLight *light = &fake_lights[i];
+        printf("%-3s effect %d  rgb %06X  duration %5d  cycles %3d\033[K\n",
+               light->name, light->effect, light->color, light->duration, light->cycles);
+    }
+    printf("max_scale %d  attribute writes/s %d\033[K\n", max_scale, writes_per_second);
+    fflush(stdout);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *dir = argc > 1 ? argv[1] : DEFAULT_DIR;
+    if (create_led_anim(dir) != 0)
+        return 1;
+
+    int inotify_fd = inotify_init1(IN_NONBLOCK);
+    if (inotify_fd < 0 || inotify_add_watch(inotify_fd, dir, IN_CLOSE_WRITE) < 0)
+    {
+        perror("Unable to watch the fake led_anim directory");
+        return 1;
+    }
+
+    signal(SIGINT, handle_signal);
+    signal(SIGTERM, handle_signal);
+
+    printf("\033[2J");
+    fprintf(stderr, "Simulating /sys/class/led_anim in %s\n", dir);
+
+    uint32_t shown[LED_COUNT];
+    bool redraw = true;
+    long stats_since = now_ms();
+    while (running)
+    {
+        // Sleep until an attribute is written, or until the next frame of an animated effect
+        struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN};
+        long next_stats = stats_since + STATS_MS - now_ms();
+        int timeout = animating(now_ms()) ? FRAME_MS : (int)(next_stats > 0 ? next_stats : 0);
+        if (poll(&pfd, 1, timeout) > 0)
+        {
+            char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+            int len;
+            while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0)
+            {
+                for (char *ptr = buffer; ptr < buffer + len;)
+                {
+                    struct inotify_event *event = (struct inotify_event *)ptr;
+                    if (event->len > 0)
+                        read_attr(dir, event->name);
+                    ptr += sizeof(struct inotify_event) + event->len;
+                }
+            }
+        }
+
+        long now = now_ms();
+        if (now - stats_since >= STATS_MS)
+        {
+            writes_per_second = writes * 1000 / (now - stats_since);
+            writes = 0;
+            stats_since = now;
+            redraw = true;
+        }
+
+        uint32_t leds[LED_COUNT];
+        compose_leds(leds, now);
+        if (redraw || memcmp(leds, shown, sizeof(leds)) != 0)
+        {
+            draw_leds(leds);
+            memcpy(shown, leds, sizeof(shown));
+            redraw = false;
+        }
+    }
+
+    close(inotify_fd);
+    printf("\n");
     return 0;
 }
@@ -20,16 +20,16 @@ cd $(dirname "$0")
 # /etc/init.d/lcservice enable >> launch.log
 
 
-# Check if deamon is running
+# Check if deamon is running: ask it to reload instead of restarting it
 if pgrep -f "lcdaemon" >/dev/null; then
     echo "lcdaemon is already running" >> launch.log
-    killall lcdaemon
+    killall -HUP lcdaemon
+else
+    # /etc/LedControl/lcdaemon  & # > lcdaemon.log 2>&1 &
+    ./lcdaemon &
+    echo "lcdaemon started" >> launch.log
 fi
 
-# /etc/LedControl/lcdaemon  & # > lcdaemon.log 2>&1 &
-./lcdaemon &
-echo "lcdaemon started" >> launch.log
-
 
 touch /tmp/led_deamon_live
 
@@ -37,5 +37,5 @@ touch /tmp/led_deamon_live
 
 rm /tmp/led_deamon_live
 
-# allow other programs to modify led states if led_daemon is set to Nothing
-chmod a+w /sys/class/led_anim/*
\ No newline at end of file
+# Other programs publish their frames through /dev/shm/led_daemon_frames (see ledshm.h),
+# lcdaemon remains the only writer of /sys/class/led_anim
\ No newline at end of file
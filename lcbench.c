@@ -0,0 +1,668 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <sys/syscall.h>
+
+// Effect benchmark: runs every software effect of lcdaemon (8 to 26) on both lights for N frames,
+// headless, writing into a fake led_anim directory on tmpfs. For each effect it reports the time of a
+// light update (median and p99), and the syscalls and heap allocations it costs per frame.
+//
+//   ./lcbench [--frames N] [--format csv|json] [--output FILE]
+//   ./lcbench --golden-generate FILE | --golden-verify FILE [--tolerance N]
+//   ./lcbench --keyframes [--format csv|json]
+//
+// Golden frames: every effect (1 to 26) is rendered on both lights for a few durations, with a fixed
+// seed and a fixed clock. For each frame, the hash of the driver files as written (frame_hex and the
+// light's attributes) and the committed colors are saved. Verifying renders them again and reports the
+// frames which differ, so that a rewrite of the render path can be proven lossless.
+// With --tolerance N, colors within N per channel are accepted, for intentional maths changes.
+//
+// Keyframes: the effects lcdaemon --keyframes can send as keyframes are scheduled like the main loop does,
+// over a virtual minute, with and without keyframes: updates, syscalls and CPU time per second.
+//
+// Syscalls: opens, closes and other file calls made by the daemon are counted here, reads and writes
+// (including the ones stdio does internally) come from /proc/self/io.
+
+#define LCDAEMON_NO_MAIN
+#include "lcdaemon.c"
+
+#define BENCH_FIRST_EFFECT 8
+#define BENCH_LAST_EFFECT 26
+#define BENCH_WARMUP_FRAMES 10
+
+#define GOLDEN_FRAMES 60
+#define GOLDEN_VERSION 2
+
+const int golden_durations[] = {200, 500, 1500};
+
+const char *bench_effect_names[] = {
+    "Linear", "Breathe", "Interval Breathe", "Static", "Blink 1", "Blink 2", "Blink 3",       // 1-7
+    "Color Drift", "Twinkle", "Fire", "Glitter", "NeonGlow", "Firefly", "Aurora", "Reactive", // 8-15
+    "Battery Level", "CPU Speed", "CPU Temperature", "Ambilight", "Nothing",                 // 16-20
+    "Rainbow Snake", "Rotation", "Rotation Mirror", "Directions",                            // 21-24
+    "Stick Tracker", "Audio Spectrum"};                                                      // 25-26
+
+bool bench_counting = false;
+unsigned long bench_file_calls = 0;
+unsigned long bench_allocs = 0;
+
+// =========== Interposed calls ===========
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+void *malloc(size_t size)
+{
+    if (bench_counting)
+        bench_allocs++;
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size)
+{
+    if (bench_counting)
+        bench_allocs++;
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (bench_counting)
+        bench_allocs++;
+    return __libc_realloc(ptr, size);
+}
+
+int open(const char *path, int flags, ...)
+{
+    mode_t mode = 0;
+    if (flags & O_CREAT)
+    {
+        va_list args;
+        va_start(args, flags);
+        mode = va_arg(args, int);
+        va_end(args);
+    }
+    if (bench_counting)
+        bench_file_calls++;
+    return syscall(SYS_openat, AT_FDCWD, path, flags, mode);
+}
+
+int close(int fd)
+{
+    if (bench_counting)
+        bench_file_calls++;
+    return syscall(SYS_close, fd);
+}
+
+int access(const char *path, int mode)
+{
+    if (bench_counting)
+        bench_file_calls++;
+    return syscall(SYS_faccessat, AT_FDCWD, path, mode, 0);
+}
+
+FILE *fopen(const char *path, const char *mode)
+{
+    static FILE *(*real_fopen)(const char *, const char *) = NULL;
+    if (real_fopen == NULL)
+        real_fopen = dlsym(RTLD_NEXT, "fopen");
+    if (bench_counting)
+        bench_file_calls++;
+    return real_fopen(path, mode);
+}
+
+int fclose(FILE *file)
+{
+    static int (*real_fclose)(FILE *) = NULL;
+    if (real_fclose == NULL)
+        real_fclose = dlsym(RTLD_NEXT, "fclose");
+    if (bench_counting && fileno(file) >= 0) // Memory streams have no descriptor
+        bench_file_calls++;
+    return real_fclose(file);
+}
+
+// read() and write() like syscalls made by the process so far
+unsigned long bench_io_syscalls()
+{
+    bool counting = bench_counting;
+    bench_counting = false;
+
+    unsigned long total = 0;
+    FILE *file = fopen("/proc/self/io", "r");
+    if (file != NULL)
+    {
+        char line[128];
+        unsigned long value;
+        while (fgets(line, sizeof(line), file))
+        {
+            if (sscanf(line, "syscr: %lu", &value) == 1 || sscanf(line, "syscw: %lu", &value) == 1)
+                total += value;
+        }
+        fclose(file);
+    }
+
+    bench_counting = counting;
+    return total;
+}
+
+// =========== Fake output ===========
+
+char bench_dir[64];
+
+void bench_create_file(const char *name, const char *value)
+{
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), "%s/%s", bench_dir, name);
+    FILE *file = fopen(filepath, "w");
+    if (file != NULL)
+    {
+        fputs(value, file);
+        fclose(file);
+    }
+}
+
+int bench_create_sandbox()
+{
+    snprintf(bench_dir, sizeof(bench_dir), "/dev/shm/lcbench.%d", getpid());
+    if (mkdir(bench_dir, 0700) != 0)
+    {
+        perror(bench_dir);
+        return -1;
+    }
+
+    const char *files[] = {"frame_hex", "max_scale", "battery", "cpufreq", "thermal",
+                           "effect_m", "effect_rgb_hex_m", "effect_duration_m", "effect_cycles_m",
+                           "effect_lr", "effect_rgb_hex_lr", "effect_duration_lr", "effect_cycles_lr"};
+    for (int i = 0; i < (int)(sizeof(files) / sizeof(files[0])); i++)
+        bench_create_file(files[i], "0\n");
+    bench_create_file("battery", "55\n");
+    bench_create_file("cpufreq", "1200000\n");
+    bench_create_file("thermal", "65000\n");
+
+    snprintf(PATH(PATH_LED_ANIM), sizeof(paths[0].value), "%s", bench_dir);
+    snprintf(PATH(PATH_BATTERY), sizeof(paths[0].value), "%s/battery", bench_dir);
+    snprintf(PATH(PATH_CPUFREQ), sizeof(paths[0].value), "%s/cpufreq", bench_dir);
+    snprintf(PATH(PATH_THERMAL), sizeof(paths[0].value), "%s/thermal", bench_dir);
+    snprintf(PATH(PATH_LIVE_FLAG), sizeof(paths[0].value), "%s/live", bench_dir); // Not in live mode
+    return 0;
+}
+
+void bench_remove_sandbox()
+{
+    DIR *dir = opendir(bench_dir);
+    if (dir == NULL)
+        return;
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        if (entry->d_name[0] == '.')
+            continue;
+        char filepath[512];
+        snprintf(filepath, sizeof(filepath), "%s/%s", bench_dir, entry->d_name);
+        unlink(filepath);
+    }
+    closedir(dir);
+    rmdir(bench_dir);
+}
+
+// =========== Benchmark ===========
+
+typedef struct
+{
+    int effect;
+    const char *light;
+    int frames;
+    long ns_median;
+    long ns_p99;
+    double syscalls_per_frame;
+    double allocs_per_frame;
+} BenchResult;
+
+int compare_long(const void *a, const void *b)
+{
+    long x = *(const long *)a;
+    long y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+long elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1000000000L + (end->tv_nsec - start->tv_nsec);
+}
+
+// One light update, as done by the daemon on every frame
+void bench_frame(LightSettings *light)
+{
+    changebrightness(PATH(PATH_LED_ANIM), light->brightness);
+    update_light_settings(light, PATH(PATH_LED_ANIM));
+    flush_output_frame(PATH(PATH_LED_ANIM));
+}
+
+BenchResult bench_effect(LightSettings *light, int effect, int frames, long *samples)
+{
+    light->effect = effect;
+    light->last_effect = effect;
+    light->progress = 0.0f;
+    for (int i = 0; i < BENCH_WARMUP_FRAMES; i++)
+        bench_frame(light);
+
+    unsigned long io_before = bench_io_syscalls();
+    unsigned long io_overhead = bench_io_syscalls() - io_before; // Reading /proc/self/io itself
+    io_before = bench_io_syscalls();
+    bench_file_calls = 0;
+    bench_allocs = 0;
+    bench_counting = true;
+
+    for (int i = 0; i < frames; i++)
+    {
+        struct timespec start, end;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        bench_frame(light);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        samples[i] = elapsed_ns(&start, &end);
+    }
+
+    bench_counting = false;
+    unsigned long io_syscalls = bench_io_syscalls() - io_before - io_overhead;
+
+    qsort(samples, frames, sizeof(long), compare_long);
+    BenchResult result = {
+        .effect = effect,
+        .light = light->name,
+        .frames = frames,
+        .ns_median = samples[frames / 2],
+        .ns_p99 = samples[(frames * 99) / 100 < frames ? (frames * 99) / 100 : frames - 1],
+        .syscalls_per_frame = (double)(io_syscalls + bench_file_calls) / frames,
+        .allocs_per_frame = (double)bench_allocs / frames,
+    };
+    return result;
+}
+
+void print_results(FILE *out, const BenchResult *results, int count, bool json)
+{
+    if (json)
+        fprintf(out, "[\n");
+    else
+        fprintf(out, "effect,name,light,frames,ns_median,ns_p99,syscalls_per_frame,allocs_per_frame\n");
+
+    for (int i = 0; i < count; i++)
+    {
+        const BenchResult *r = &results[i];
+        const char *name = bench_effect_names[r->effect - 1];
+        if (json)
+            fprintf(out, "  {\"effect\": %d, \"name\": \"%s\", \"light\": \"%s\", \"frames\": %d, \"ns_median\": %ld, \"ns_p99\": %ld, "
+                         "\"syscalls_per_frame\": %.2f, \"allocs_per_frame\": %.2f}%s\n",
+                    r->effect, name, r->light, r->frames, r->ns_median, r->ns_p99,
+                    r->syscalls_per_frame, r->allocs_per_frame, i + 1 < count ? "," : "");
+        else
+            fprintf(out, "%d,%s,%s,%d,%ld,%ld,%.2f,%.2f\n",
+                    r->effect, name, r->light, r->frames, r->ns_median, r->ns_p99,
+                    r->syscalls_per_frame, r->allocs_per_frame);
+    }
+
+    if (json)
+        fprintf(out, "]\n");
+}
+
+// =========== Golden frames ===========
+
+// Same state as when the daemon (re)starts an effect
+void golden_reset(LightSettings *light, int effect, int duration)
+{
+    srand(1);
+    light->effect = effect;
+    light->last_effect = effect;
+    light->duration = duration;
+    light->progress = 0.0f;
+    memset(light->hit_ms, 0, sizeof(light->hit_ms));
+    light->written_hash = 0;
+    light->written_ms = 0;
+    light->next_update_ms = 0;
+    int initialColorArray[5] = {light->color, 0xFF0000, 0xFF0000, 0xFF0000, 0xFF0000};
+    memset(light->colorarray, 0, sizeof(light->colorarray));
+    memcpy(light->colorarray, initialColorArray, sizeof(initialColorArray));
+    memset(committed_frame, 0, sizeof(committed_frame));
+    first_run = true;
+}
+
+// Hash of what the driver sees after a frame: frame_hex and the light's attributes, as written
+uint64_t golden_output_hash(LightSettings *light)
+{
+    const char *attrs[] = {"effect", "effect_rgb_hex", "effect_duration", "effect_cycles"};
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    for (int i = -1; i < (int)(sizeof(attrs) / sizeof(attrs[0])); i++)
+    {
+        char filepath[256];
+        if (i < 0)
+            snprintf(filepath, sizeof(filepath), "%s/frame_hex", bench_dir);
+        else
+            snprintf(filepath, sizeof(filepath), "%s/%s_%s", bench_dir, attrs[i], light->name);
+        char content[LEDSHM_LED_COUNT * 7 + 64];
+        size_t size = 0;
+        FILE *file = fopen(filepath, "r");
+        if (file != NULL)
+        {
+            size = fread(content, 1, sizeof(content), file);
+            fclose(file);
+        }
+        hash = hash_bytes(hash, content, size);
+        hash = hash_bytes(hash, "|", 1);
+    }
+    return hash;
+}
+
+int golden_max_delta(const uint32_t *a, const uint32_t *b)
+{
+    int max = 0;
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+    {
+        for (int shift = 0; shift < 24; shift += 8)
+        {
+            int delta = abs((int)((a[i] >> shift) & 0xFF) - (int)((b[i] >> shift) & 0xFF));
+            if (delta > max)
+                max = delta;
+        }
+    }
+    return max;
+}
+
+int run_golden(FILE *out, const char *path, bool generate, int tolerance)
+{
+    FILE *golden = fopen(path, generate ? "w" : "r");
+    if (golden == NULL)
+    {
+        perror(path);
+        return 1;
+    }
+
+    char line[512];
+    int version = 0;
+    if (generate)
+        fprintf(golden, "# lcbench golden frames v%d: effect light duration frame hash colors\n", GOLDEN_VERSION);
+    else if (fgets(line, sizeof(line), golden) == NULL || sscanf(line, "# lcbench golden frames v%d", &version) != 1 || version != GOLDEN_VERSION)
+    {
+        fprintf(stderr, "%s: not a golden file of this version, generate it again\n", path);
+        fclose(golden);
+        return 1;
+    }
+
+    virtual_clock = true;
+    virtual_now_us = 1000000000L; // Far from 0, so that the sensors are read on the first frame
+    unsigned long frames = 0, identical = 0, tolerated = 0, failed = 0;
+    int num_durations = sizeof(golden_durations) / sizeof(golden_durations[0]);
+
+    for (int effect = 1; effect <= BENCH_LAST_EFFECT; effect++)
+    {
+        if (effect == 19)
+            continue; // Ambilight spawns an external script
+        for (int i = 0; i < num_lights; i++)
+        {
+            for (int d = 0; d < num_durations; d++)
+            {
+                LightSettings *light = &lights[i];
+                golden_reset(light, effect, golden_durations[d]);
+                bool reported = false;
+
+                for (int frame = 0; frame < GOLDEN_FRAMES; frame++)
+                {
+                    virtual_now_us += 50000;
+                    bench_frame(light);
+                    first_run = false;
+                    frames++;
+
+                    uint64_t hash = golden_output_hash(light);
+                    if (generate)
+                    {
+                        fprintf(golden, "%d %s %d %d %016llX", effect, light->name, light->duration, frame, (unsigned long long)hash);
+                        for (int led = 0; led < LEDSHM_LED_COUNT; led++)
+                            fprintf(golden, " %06X", committed_frame[led]);
+                        fprintf(golden, "\n");
+                        continue;
+                    }
+
+                    int g_effect, g_duration, g_frame, offset;
+                    char g_light[MAX_NAME_LEN];
+                    unsigned long long g_hash;
+                    if (fgets(line, sizeof(line), golden) == NULL ||
+                        sscanf(line, "%d %49s %d %d %llX%n", &g_effect, g_light, &g_duration, &g_frame, &g_hash, &offset) != 5 ||
+                        g_effect != effect || strcmp(g_light, light->name) != 0 || g_duration != light->duration || g_frame != frame)
+                    {
+                        fprintf(stderr, "%s: does not match this build (effect %d, light %s, duration %d, frame %d), generate it again\n",
+                                path, effect, light->name, light->duration, frame);
+                        fclose(golden);
+                        return 1;
+                    }
+                    uint32_t g_colors[LEDSHM_LED_COUNT];
+                    char *next = line + offset;
+                    for (int led = 0; led < LEDSHM_LED_COUNT; led++)
+                        g_colors[led] = strtoul(next, &next, 16);
+                    int delta = golden_max_delta(g_colors, committed_frame);
+                    if (delta == 0 && g_hash == hash)
+                    {
+                        identical++;
+                        continue;
+                    }
+                    if (delta > 0 && delta <= tolerance) // The written colors drift as much, so the hash differs too
+                    {
+                        tolerated++;
+                        continue;
+                    }
+
+                    failed++;
+                    if (!reported)
+                    {
+                        if (delta == 0)
+                            fprintf(out, "FAIL effect %d (%s) light %s duration %d: frame %d writes different driver files\n",
+                                    effect, bench_effect_names[effect - 1], light->name, light->duration, frame);
+                        else
+                            fprintf(out, "FAIL effect %d (%s) light %s duration %d: frame %d differs (max channel delta %d)\n",
+                                    effect, bench_effect_names[effect - 1], light->name, light->duration, frame, delta);
+                        reported = true; // First frame only, the following ones usually differ too
+                    }
+                }
+            }
+        }
+    }
+    virtual_clock = false;
+    fclose(golden);
+
+    if (generate)
+        fprintf(out, "%lu golden frames written to %s\n", frames, path);
+    else
+        fprintf(out, "%lu frames: %lu identical, %lu within tolerance, %lu failed\n", frames, identical, tolerated, failed);
+    return failed > 0;
+}
+
+// =========== Keyframes ===========
+
+#define KEYFRAME_BENCH_MS 60000
+
+const int keyframe_durations[] = {500, 1000, 3000};
+
+typedef struct
+{
+    double updates_per_s;
+    double syscalls_per_s;
+    double cpu_us_per_s;
+} ScheduleCost;
+
+long cpu_time_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+// Frames of a light as scheduled by the main loop: it is only updated once its next keyframe is due
+ScheduleCost bench_schedule(LightSettings *light, int effect, int duration, bool use_keyframes)
+{
+    keyframes = use_keyframes;
+    golden_reset(light, effect, duration);
+    virtual_clock = true;
+    long start_us = virtual_now_us = 1000000000L;
+
+    unsigned long updates = 0;
+    unsigned long io_before = bench_io_syscalls();
+    long cpu_before = cpu_time_us();
+    bench_file_calls = 0;
+    bench_counting = true;
+    for (long t = 0; t < KEYFRAME_BENCH_MS; t += FRAME_MS)
+    {
+        virtual_now_us = start_us + t * 1000;
+        frame_ms = now_ms();
+        if (frame_ms >= light->next_update_ms)
+        {
+            bench_frame(light);
+            first_run = false;
+            updates++;
+        }
+    }
+    bench_counting = false;
+    long cpu_us = cpu_time_us() - cpu_before;
+    unsigned long syscalls = bench_io_syscalls() - io_before + bench_file_calls;
+    virtual_clock = false;
+    keyframes = false;
+
+    double seconds = KEYFRAME_BENCH_MS / 1000.0;
+    ScheduleCost cost = {updates / seconds, syscalls / seconds, cpu_us / seconds};
+    return cost;
+}
+
+void run_keyframes(FILE *out, bool json)
+{
+    if (json)
+        fprintf(out, "[\n");
+    else
+        fprintf(out, "effect,name,light,duration,updates_per_s,keyframe_updates_per_s,syscalls_per_s,keyframe_syscalls_per_s,cpu_us_per_s,keyframe_cpu_us_per_s\n");
+
+    int num_durations = sizeof(keyframe_durations) / sizeof(keyframe_durations[0]);
+    bool first = true;
+    for (int effect = 1; effect <= BENCH_LAST_EFFECT; effect++)
+    {
+        if (keyframe_segments(effect) == 0)
+            continue;
+        for (int i = 0; i < num_lights; i++)
+        {
+            for (int d = 0; d < num_durations; d++)
+            {
+                LightSettings *light = &lights[i];
+                ScheduleCost ticked = bench_schedule(light, effect, keyframe_durations[d], false);
+                ScheduleCost keyed = bench_schedule(light, effect, keyframe_durations[d], true);
+                const char *name = bench_effect_names[effect - 1];
+                if (json)
+                    fprintf(out, "%s  {\"effect\": %d, \"name\": \"%s\", \"light\": \"%s\", \"duration\": %d, "
+                                 "\"updates_per_s\": %.2f, \"keyframe_updates_per_s\": %.2f, \"syscalls_per_s\": %.1f, \"keyframe_syscalls_per_s\": %.1f, "
+                                 "\"cpu_us_per_s\": %.1f, \"keyframe_cpu_us_per_s\": %.1f}",
+                            first ? "" : ",\n", effect, name, light->name, keyframe_durations[d], ticked.updates_per_s, keyed.updates_per_s,
+                            ticked.syscalls_per_s, keyed.syscalls_per_s, ticked.cpu_us_per_s, keyed.cpu_us_per_s);
+                else
+                    fprintf(out, "%d,%s,%s,%d,%.2f,%.2f,%.1f,%.1f,%.1f,%.1f\n", effect, name, light->name, keyframe_durations[d],
+                            ticked.updates_per_s, keyed.updates_per_s, ticked.syscalls_per_s, keyed.syscalls_per_s,
+                            ticked.cpu_us_per_s, keyed.cpu_us_per_s);
+                first = false;
+            }
+        }
+    }
+
+    if (json)
+        fprintf(out, "\n]\n");
+}
+
+int main(int argc, char *argv[])
+{
+    int frames = 1000;
+    bool json = false;
+    const char *output = NULL;
+    const char *golden_path = NULL;
+    bool golden_generate = false;
+    int tolerance = 0;
+    bool keyframe_report = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frames = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc)
+            json = strcmp(argv[++i], "json") == 0;
+        else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc)
+            output = argv[++i];
+        else if ((strcmp(argv[i], "--golden-generate") == 0 || strcmp(argv[i], "--golden-verify") == 0) && i + 1 < argc)
+        {
+            golden_generate = strcmp(argv[i], "--golden-generate") == 0;
+            golden_path = argv[++i];
+        }
+        else if (strcmp(argv[i], "--tolerance") == 0 && i + 1 < argc)
+            tolerance = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--keyframes") == 0)
+            keyframe_report = true;
+        else if (strcmp(argv[i], "--audio-wav") == 0 && i + 1 < argc)
+            audio_wav_path = argv[++i];
+        else
+        {
+            fprintf(stderr, "Usage: %s [--frames N] [--format csv|json] [--output FILE] [--audio-wav FILE]\n", argv[0]);
+            fprintf(stderr, "       %s --golden-generate FILE | --golden-verify FILE [--tolerance N]\n", argv[0]);
+            fprintf(stderr, "       %s --keyframes [--format csv|json] [--output FILE]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (frames < 1)
+        frames = 1;
+
+    // Effects print debug output: keep it out of the results
+    FILE *out = output ? fopen(output, "w") : fdopen(dup(STDOUT_FILENO), "w");
+    if (out == NULL || freopen("/dev/null", "w", stdout) == NULL)
+    {
+        perror(output ? output : "stdout");
+        return 1;
+    }
+
+    configure_paths(1, argv);
+    if (bench_create_sandbox() != 0)
+        return 1;
+
+    const char *light_names[] = {"m", "lr"};
+    for (int i = 0; i < 2; i++)
+    {
+        LightSettings *light = get_light(light_names[i]);
+        light->color = 0xFF8000;
+        light->color2 = 0x0080FF;
+        light->duration = 500;
+        light->brightness = 40;
+        light->trigger = 1;
+    }
+    first_run = false;
+    transition_ms = 0; // Each effect is measured on its own, not crossfading from the previous one
+    audio_device = NULL; // Audio Spectrum renders silence, unless given --audio-wav
+
+    if (golden_path != NULL)
+    {
+        int failed = run_golden(out, golden_path, golden_generate, tolerance);
+        bench_remove_sandbox();
+        fclose(out);
+        return failed;
+    }
+    if (keyframe_report)
+    {
+        run_keyframes(out, json);
+        bench_remove_sandbox();
+        fclose(out);
+        return 0;
+    }
+
+    long *samples = malloc(frames * sizeof(long));
+    BenchResult results[2 * (BENCH_LAST_EFFECT - BENCH_FIRST_EFFECT + 1)];
+    int count = 0;
+    for (int effect = BENCH_FIRST_EFFECT; effect <= BENCH_LAST_EFFECT; effect++)
+    {
+        if (effect == 19)
+            continue; // Ambilight spawns an external script, nothing to measure in the daemon
+        for (int i = 0; i < num_lights; i++)
+            results[count++] = bench_effect(&lights[i], effect, frames, samples);
+    }
+    free(samples);
+    bench_remove_sandbox();
+
+    print_results(out, results, count, json);
+    fclose(out);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef LCCTL_H
+#define LCCTL_H
+
+// Control socket served by lcdaemon, used by ledctl and scripts.
+// One command per datagram, plain text, e.g.:
+//   set <light> <effect|color|color2|duration|brightness|trigger|triggers> <value>
+//   flash <light> <RRGGBB> [ms]
+//   get [light]
+//   stats
+// When the sender is bound to an address, the daemon answers with a single datagram
+// starting with "ok" or "error".
+
+#define LCCTL_SOCKET_PATH "/tmp/lcdaemon.sock"
+#define LCCTL_MAX_MESSAGE 1024
+#define LCCTL_FLASH_DEFAULT_MS 200
+
+#endif
@@ -1,1304 +1,3707 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <signal.h>
-#include <stdbool.h>
-#include <stdint.h>
-#include <ctype.h>
-#include <math.h>
-#include <SDL2/SDL.h>
-#include <time.h>
-
-#include <fcntl.h>
-#include <unistd.h>
-#include <linux/joystick.h>
-#include <sys/stat.h>
-#include <dirent.h>
-#include <string.h>
-
-#define MAX_LIGHTS 2
-#define MAX_NAME_LEN 50
-
-typedef struct
-{
-    char name[MAX_NAME_LEN];
-    int effect;
-    int last_effect;
-    int duration;
-    int brightness;
-    uint32_t color;
-    uint32_t color2;
-    bool updated;
-    int current_r;
-    int current_g;
-    int current_b;
-    float progress;
-    int colorarray[24];
-    int trigger;
-    int running;
-
-} LightSettings;
-
-bool first_run = true;
-bool pressed = false;
-int last_pressed = 0;
-
-float progress = 0.0f;
-
-int current_r;
-int current_g;
-int current_b;
-
-int dpad_x = 0;
-int dpad_y = 0;
-
-volatile sig_atomic_t running = 1;
-
-int jsopen = 0; // Flag to keep track of whether the file is open
-
-void chmodfile(const char *file, int writable)
-{
-    return;
-    struct stat statbuf;
-    if (stat(file, &statbuf) == 0)
-    {
-        mode_t newMode;
-        if (writable)
-        {
-            // Add write permissions for all users
-            newMode = statbuf.st_mode | S_IWUSR | S_IWGRP | S_IWOTH;
-        }
-        else
-        {
-            // Remove write permissions for all users
-            newMode = statbuf.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH);
-        }
-
-        // Apply the new permissions
-        if (chmod(file, newMode) != 0)
-        {
-            printf("chmod error %d %s", writable, file);
-        }
-    }
-    else
-    {
-        printf("stat error %d %s", writable, file);
-    }
-}
-
-void changePermissions(const char *path, int writable)
-{
-
-    DIR *dir;
-    struct dirent *entry;
-
-    // Open the directory
-    if ((dir = opendir(path)) != NULL)
-    {
-        while ((entry = readdir(dir)) != NULL)
-        {
-            // Skip "." and ".." entries
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            {
-                continue;
-            }
-
-            // Construct new path
-            char newPath[1024];
-            snprintf(newPath, sizeof(newPath), "%s/%s", path, entry->d_name);
-
-            // Get current permissions
-            struct stat statbuf;
-            if (stat(newPath, &statbuf) == 0)
-            {
-                mode_t newMode;
-                if (writable)
-                {
-                    // Add write permissions for all users
-                    newMode = statbuf.st_mode | S_IWUSR | S_IWGRP | S_IWOTH;
-                }
-                else
-                {
-                    // Remove write permissions for all users
-                    newMode = statbuf.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH);
-                }
-
-                // Apply the new permissions
-                if (chmod(newPath, newMode) != 0)
-                {
-                    printf("error chmod\n");
-                }
-            }
-            else
-            {
-                printf("error stat\n");
-            }
-        }
-        closedir(dir);
-    }
-    else
-    {
-        perror("opendir");
-    }
-}
-
-int get_mainui_brightness()
-{
-    static int cached_value = 60; // default value
-    static time_t last_read = 0;
-
-    time_t now = time(NULL);
-    if (now - last_read >= 5)
-    {
-        FILE *fp = popen("/usr/trimui/bin/shmvar ledvalue", "r");
-        if (fp)
-        {
-            char buffer[32];
-            if (fgets(buffer, sizeof(buffer), fp))
-            {
-                int ui_value = atoi(buffer);
-                cached_value = (ui_value * 60) / 10;
-            }
-            pclose(fp);
-        }
-        last_read = now;
-    }
-
-    return cached_value;
-}
-
-void changebrightness(const char *dir, int value)
-{
-    char filepath[256];
-    FILE *file;
-
-    if (value == -1) // The brightness is controlled by MainUI
-    {
-        if (access("/tmp/led_deamon_live", F_OK) == 0)
-        {
-            value = get_mainui_brightness(); // get from shmvar, cached every 5s
-        }
-        else
-        {
-            // Do not touch max_scale if not running in live mode
-            return;
-        }
-    }
-
-    // Only one global brightness value for all LEDs on TSP
-    snprintf(filepath, sizeof(filepath), "%s/max_scale", dir);
-    chmodfile(filepath, 1);
-
-    file = fopen(filepath, "w");
-    if (file != NULL)
-    {
-        fprintf(file, "%d\n", value);
-        fclose(file);
-    }
-
-    chmodfile(filepath, 0);
-}
-
-void handle_sigterm(int sig)
-{
-    running = 0;
-}
-
-void handle_sigcont(int sig)
-{
-    changePermissions("/sys/class/led_anim", 0);
-    first_run = true;
-}
-void handle_sigsleep()
-{
-    changePermissions("/sys/class/led_anim", 1);
-}
-
-int read_settings(const char *filename, LightSettings *lights, int max_lights)
-{
-    FILE *file;
-
-    char shmfile[256];
-    snprintf(shmfile, sizeof(shmfile), "/mnt/SDCARD/System/etc/%s", filename);
-    file = fopen(shmfile, "r");
-    if (file == NULL)
-    {
-        perror("Unable to open /mnt/SDCARD/System/etc/ file");
-        fclose(file);
-        return 1;
-    }
-
-    char line[256];
-    int current_light = -1;
-    while (fgets(line, sizeof(line), file))
-    {
-        if (line[0] == '[')
-        {
-            // Section header
-            char light_name[MAX_NAME_LEN];
-            if (sscanf(line, "[%49[^]]]", light_name) == 1)
-            {
-                if (strcmp(light_name, "m") == 0)
-                    current_light = 0;
-                else if (strcmp(light_name, "lr") == 0)
-                    current_light = 1;
-                else
-                    current_light = -1; // ignores others
-
-                if (current_light != -1)
-                {
-                    strncpy(lights[current_light].name, light_name, MAX_NAME_LEN - 1);
-                    lights[current_light].name[MAX_NAME_LEN - 1] = '\0';
-                    lights[current_light].updated = false;
-                }
-            }
-        }
-        else if (current_light >= 0 && current_light < max_lights)
-        {
-            int temp_value;
-            uint32_t temp_color;
-
-            if (sscanf(line, "effect=%d", &temp_value) == 1)
-            {
-                if (lights[current_light].effect != temp_value)
-                {
-                    printf("effect changed\n");
-                    lights[current_light].effect = temp_value;
-                    lights[current_light].updated = true;
-                }
-                continue;
-            }
-            if (sscanf(line, "color=%x", &temp_color) == 1)
-            {
-                if (lights[current_light].color != temp_color)
-                {
-                    lights[current_light].color = temp_color;
-                    lights[current_light].updated = true;
-                }
-                continue;
-            }
-            if (sscanf(line, "color2=%x", &temp_color) == 1)
-            {
-                if (lights[current_light].color2 != temp_color)
-                {
-                    lights[current_light].color2 = temp_color;
-                    lights[current_light].updated = true;
-                }
-                continue;
-            }
-            if (sscanf(line, "duration=%d", &temp_value) == 1)
-            {
-                if (lights[current_light].duration != temp_value)
-                {
-                    lights[current_light].duration = temp_value;
-                    lights[current_light].updated = true;
-                }
-                continue;
-            }
-            if (sscanf(line, "brightness=%d", &temp_value) == 1)
-            {
-                if (lights[current_light].brightness != temp_value)
-                {
-                    lights[current_light].brightness = temp_value;
-                    lights[current_light].updated = true;
-                }
-                continue;
-            }
-            if (sscanf(line, "trigger=%d", &temp_value) == 1)
-            {
-                if (lights[current_light].trigger != temp_value)
-                {
-                    lights[current_light].trigger = temp_value;
-                    lights[current_light].updated = true;
-                }
-                continue;
-            }
-        }
-    }
-
-    fclose(file);
-    return 0;
-}
-
-// Function to convert integer hex code to SDL_Color
-SDL_Color HexIntToColor(unsigned int hexValue)
-{
-    SDL_Color color = {0, 0, 0, 255}; // Default to black with full opacity
-
-    // Extract RGB values from the integer hex code
-    color.r = (hexValue >> 16) & 0xFF;
-    color.g = (hexValue >> 8) & 0xFF;
-    color.b = hexValue & 0xFF;
-
-    return color;
-}
-
-void HSVtoRGB(float h, float s, float v, int *r, int *g, int *b)
-{
-    int i = floor(h / 60);
-    float f = h / 60 - i;
-    float p = v * (1 - s);
-    float q = v * (1 - s * f);
-    float t = v * (1 - s * (1 - f));
-    switch (i)
-    {
-    case 0:
-        *r = v * 255;
-        *g = t * 255;
-        *b = p * 255;
-        break;
-    case 1:
-        *r = q * 255;
-        *g = v * 255;
-        *b = p * 255;
-        break;
-    case 2:
-        *r = p * 255;
-        *g = v * 255;
-        *b = t * 255;
-        break;
-    case 3:
-        *r = p * 255;
-        *g = q * 255;
-        *b = v * 255;
-        break;
-    case 4:
-        *r = t * 255;
-        *g = p * 255;
-        *b = v * 255;
-        break;
-    default:
-        *r = v * 255;
-        *g = p * 255;
-        *b = q * 255;
-        break;
-    }
-}
-void CycleBetweenTwoColors(float progress, int r1, int g1, int b1, int r2, int g2, int b2, int *r, int *g, int *b)
-{
-    *r = r1 + (r2 - r1) * progress;
-    *g = g1 + (g2 - g1) * progress;
-    *b = b1 + (b2 - b1) * progress;
-}
-void PulseEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
-{
-    float factor = (sin(progress * 2 * M_PI) + 1) / 2; // Create a sine wave effect
-    *r = base_r * factor;
-    *g = base_g * factor;
-    *b = base_b * factor;
-}
-void GradientShift(float progress, int r1, int g1, int b1, int r2, int g2, int b2, int r3, int g3, int b3, int *r, int *g, int *b)
-{
-    float section = fmod(progress * 3.0, 3.0);
-    if (section < 1)
-    {
-        CycleBetweenTwoColors(section, r1, g1, b1, r2, g2, b2, r, g, b);
-    }
-    else if (section < 2)
-    {
-        CycleBetweenTwoColors(section - 1, r2, g2, b2, r3, g3, b3, r, g, b);
-    }
-    else
-    {
-        CycleBetweenTwoColors(section - 2, r3, g3, b3, r1, g1, b1, r, g, b);
-    }
-}
-
-void TwinkleEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
-{
-    float factor = ((rand() % 100) / 100.0f) * (sin(progress * M_PI * 2) + 1) / 2;
-    *r = base_r * factor;
-    *g = base_g * factor;
-    *b = base_b * factor;
-}
-
-void FireEffect(float progress, int *r, int *g, int *b)
-{
-    float section = fmod(progress * 3.0, 3.0);
-    if (section < 1)
-    {
-        CycleBetweenTwoColors(section, 255, 0, 0, 255, 165, 0, r, g, b); // Red to Orange
-    }
-    else if (section < 2)
-    {
-        CycleBetweenTwoColors(section - 1, 255, 165, 0, 255, 255, 0, r, g, b); // Orange to Yellow
-    }
-    else
-    {
-        CycleBetweenTwoColors(section - 2, 255, 255, 0, 255, 0, 0, r, g, b); // Yellow to Red
-    }
-}
-
-void GlitterEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
-{
-    float factor = ((rand() % 100) / 100.0f) * (sin(progress * M_PI * 2) + 1) / 2;
-    if (rand() % 2)
-    {
-        *r = base_r * factor;
-        *g = base_g * factor;
-        *b = base_b * factor;
-    }
-    else
-    {
-        *r = base_r;
-        *g = base_g;
-        *b = base_b;
-    }
-}
-
-void NeonGlowEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
-{
-    float factor = (sin(progress * M_PI * 2) + 1) / 2;
-    *r = base_r * factor;
-    *g = base_g * factor;
-    *b = base_b * factor;
-}
-
-void FireflyEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
-{
-    float factor = ((rand() % 100) / 100.0f) * (sin(progress * M_PI * 2) + 1) / 2;
-    if (rand() % 2)
-    {
-        *r = base_r * factor;
-        *g = base_g * factor;
-        *b = base_b * factor;
-    }
-    else
-    {
-        *r = 0;
-        *g = 0;
-        *b = 0;
-    }
-}
-
-void AuroraEffect(float progress, int *r, int *g, int *b)
-{
-    float section = fmod(progress * 2.0, 2.0);
-    if (section < 1)
-    {
-        CycleBetweenTwoColors(section, 0, 255, 128, 0, 255, 255, r, g, b); // Green to Cyan
-    }
-    else
-    {
-        CycleBetweenTwoColors(section - 1, 0, 255, 255, 0, 128, 255, r, g, b); // Cyan to Blue
-    }
-}
-
-void ColorWave(float progress, int *r, int *g, int *b)
-{
-    float h = fmod(progress * 360.0, 360.0);
-    float s = 1.0, v = 1.0; // Saturation and brightness are constant
-    HSVtoRGB(h, s, v, r, g, b);
-}
-
-void FadeToBlack(int *r, int *g, int *b, float fadeAmount)
-{
-
-    fadeAmount = fadeAmount * 5.0f;
-    if (fadeAmount < 0)
-        fadeAmount = 0;
-    if (fadeAmount > 1)
-        fadeAmount = 1;
-
-    // Calculate the faded RGB values based on fadeAmount
-    *r = *r * (1 - fadeAmount);
-    *g = *g * (1 - fadeAmount);
-    *b = *b * (1 - fadeAmount);
-}
-
-float mapSpeedToProgress(int speed)
-{
-    float progress;
-    if (speed <= 500)
-    {
-        // Map speed from 0 to 1000 to progress from 0.05 to 0.01
-        float maxSpeedSegment1 = 500.0f;
-        float minSpeedSegment1 = 0.0f;
-        float maxProgressSegment1 = 1.1f;
-        float minProgressSegment1 = 0.1f;
-
-        progress = maxProgressSegment1 - ((speed - minSpeedSegment1) / (maxSpeedSegment1 - minSpeedSegment1)) * (maxProgressSegment1 - minProgressSegment1);
-    }
-    else if (speed <= 1000)
-    {
-        // Map speed from 0 to 1000 to progress from 0.05 to 0.01
-        float maxSpeedSegment1 = 1000.0f;
-        float minSpeedSegment1 = 500.0f;
-        float maxProgressSegment1 = 0.1f;
-        float minProgressSegment1 = 0.01f;
-
-        progress = maxProgressSegment1 - ((speed - minSpeedSegment1) / (maxSpeedSegment1 - minSpeedSegment1)) * (maxProgressSegment1 - minProgressSegment1);
-    }
-    else if (speed <= 4900)
-    {
-        // Map speed from 1000 to 4900 to progress from 0.01 to 0.001
-        float maxSpeedSegment2 = 4900.0f;
-        float minSpeedSegment2 = 1000.0f;
-        float maxProgressSegment2 = 0.01f;
-        float minProgressSegment2 = 0.001f;
-
-        progress = maxProgressSegment2 - ((speed - minSpeedSegment2) / (maxSpeedSegment2 - minSpeedSegment2)) * (maxProgressSegment2 - minProgressSegment2);
-    }
-    else
-    {
-        // Handle out-of-range values gracefully
-        progress = 0.001f; // Assuming the slowest value if speed > 4900
-    }
-
-    return progress;
-}
-
-void shiftColors(int colors[], int size)
-{
-    int last = colors[size - 1];
-    for (int i = size - 1; i > 0; i--)
-    {
-        colors[i] = colors[i - 1];
-    }
-    colors[0] = last;
-}
-
-void BatteryLevelToColor(const LightSettings *light, int *r, int *g, int *b)
-{
-    static float blink_progress = 0.0f;
-    static int last_level = 100;
-    static time_t last_read_time = 0;
-
-    time_t now = time(NULL);
-    if (now - last_read_time >= 10)
-    {
-        FILE *batfile = fopen("/sys/class/power_supply/axp2202-battery/capacity", "r");
-        if (batfile)
-        {
-            fscanf(batfile, "%d", &last_level);
-            fclose(batfile);
-        }
-        last_read_time = now;
-    }
-
-    if (last_level < 10)
-    {
-        // Flashing with speed linked to duration parameterFlashing with speed linked to duration parameter
-        float blink_step = mapSpeedToProgress(light->duration);
-        blink_progress += blink_step;
-        if (blink_progress >= 1.0f)
-            blink_progress -= 1.0f;
-
-        float blink = (sin(blink_progress * M_PI * 2) + 1) / 2.0f;
-        *r = 255 * blink;
-        *g = 0;
-        *b = 0;
-        return;
-    }
-
-    float pct = last_level / 100.0f;
-    if (pct < 0.25f)
-    {
-        CycleBetweenTwoColors(pct / 0.25f, 255, 0, 0, 255, 69, 0, r, g, b);
-    }
-    else if (pct < 0.5f)
-    {
-        CycleBetweenTwoColors((pct - 0.25f) / 0.25f, 255, 69, 0, 255, 255, 0, r, g, b);
-    }
-    else
-    {
-        CycleBetweenTwoColors((pct - 0.5f) / 0.5f, 255, 255, 0, 0, 255, 0, r, g, b);
-    }
-}
-
-void CpuSpeedToColor(const LightSettings *light, int *r, int *g, int *b)
-{
-    static int last_mhz = 0;
-    static time_t last_read_time = 0;
-
-    time_t now = time(NULL);
-    if (now - last_read_time >= 1)
-    {
-        FILE *cpu = fopen("/sys/devices/system/cpu/cpufreq/policy0/cpuinfo_cur_freq", "r");
-        if (cpu)
-        {
-            int khz = 0;
-            if (fscanf(cpu, "%d", &khz) == 1)
-            {
-                last_mhz = khz / 1000;
-            }
-            fclose(cpu);
-        }
-        last_read_time = now;
-    }
-
-    float pct = last_mhz / 2000.0f;
-    if (pct < 0.33f)
-    {
-        CycleBetweenTwoColors(pct / 0.33f, 0, 255, 0, 127, 255, 0, r, g, b); // Green to Chartreuse
-    }
-    else if (pct < 0.66f)
-    {
-        CycleBetweenTwoColors((pct - 0.33f) / 0.33f, 127, 255, 0, 255, 140, 0, r, g, b); // Chartreuse to Orange
-    }
-    else
-    {
-        CycleBetweenTwoColors((pct - 0.66f) / 0.34f, 255, 140, 0, 255, 0, 0, r, g, b); // Orange to Red
-    }
-}
-
-void CpuTempToColor(const LightSettings *light, int *r, int *g, int *b)
-{
-    static int last_temp = 60;
-    static long last_read_time_ms = 0;
-
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    long now_ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-    if (now_ms - last_read_time_ms >= 1000) // Read every 1s
-    {
-        FILE *f = fopen("/sys/class/thermal/thermal_zone0/temp", "r");
-        if (f)
-        {
-            int temp_raw = 0;
-            if (fscanf(f, "%d", &temp_raw) == 1)
-            {
-                last_temp = temp_raw / 1000; // convert to °C
-            }
-            fclose(f);
-        }
-        last_read_time_ms = now_ms;
-    }
-
-    float pct = (last_temp - 60) / 20.0f; // map 60–80°C → 0.0–1.0
-    if (pct < 0.0f)
-        pct = 0.0f;
-    if (pct > 1.0f)
-        pct = 1.0f;
-
-    if (pct < 0.5f)
-    {
-        // Green → Orange
-        CycleBetweenTwoColors(pct / 0.5f, 0, 255, 0, 255, 165, 0, r, g, b);
-    }
-    else
-    {
-        // Orange → Red
-        CycleBetweenTwoColors((pct - 0.5f) / 0.5f, 255, 165, 0, 255, 0, 0, r, g, b);
-    }
-}
-
-void update_ambilight(const LightSettings *light)
-{
-    static long last_ms = 0;
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    long now_ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-
-    int delay_ms = light->duration;
-    if (delay_ms < 200)
-        delay_ms = 200;
-
-    if (now_ms - last_ms < delay_ms)
-        return;
-
-    last_ms = now_ms;
-
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "./ambilight_runner.sh %s &", light->name);
-    system(cmd); // Non - blocking call thanks to `&`.
-}
-
-float wastriggered = 0.0f;
-
-void update_light_settings(LightSettings *light, const char *dir)
-{
-    char filepath[256];
-    char filepath2[256];
-    FILE *file;
-    FILE *file_effect_rgb_hex;
-    FILE *file_frame_hex;
-    light->progress += mapSpeedToProgress(light->duration);
-
-    if (light->progress > 1.0f)
-        light->progress = 0.0f;
-
-    // Update effect and other settings
-    snprintf(filepath, sizeof(filepath), "%s/effect_rgb_hex_%s", dir, light->name);
-    snprintf(filepath2, sizeof(filepath2), "%s/frame_hex", dir, light->name);
-
-    chmodfile(filepath, 1);
-    chmodfile(filepath2, 1);
-    file_effect_rgb_hex = fopen(filepath, "w");
-    file_frame_hex = fopen(filepath2, "w");
-
-    if (file_effect_rgb_hex != NULL && file_frame_hex != NULL)
-    {
-        SDL_Color tempcolor = HexIntToColor(light->color);
-        int r, g, b;
-        if (light->effect == 8) // Color drift
-        {
-            ColorWave(light->progress, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-
-        else if (light->effect == 9) // TwinkleEffect
-        {
-            TwinkleEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-        else if (light->effect == 10) // FireEffect
-        {
-            FireEffect(light->progress, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-        else if (light->effect == 11) // GlitterEffect
-        {
-            GlitterEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-        else if (light->effect == 12) // NeonGlowEffect
-        {
-            NeonGlowEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-        else if (light->effect == 13) // FireEffect
-        {
-            FireflyEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-        else if (light->effect == 14) // Aurora
-        {
-            AuroraEffect(light->progress, &r, &g, &b);
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-        else if (light->effect == 15) // reactive
-        {
-            printf("pressed: %d, trigger setting: %d\n", pressed, light->trigger);
-            if (pressed)
-            {
-                int doit = 0;
-                if (light->trigger == 10 || last_pressed == light->trigger - 1)
-                {
-                    doit = 1;
-                }
-                if (light->trigger == 11 && (last_pressed == 4 || last_pressed == 5))
-                {
-                    doit = 1;
-                }
-                if (light->trigger == 12 && last_pressed == 100)
-                {
-                    doit = 1;
-                }
-                if (doit == 1)
-                {
-                    light->current_r = light->color >> 16 & 0xFF;
-                    light->current_g = light->color >> 8 & 0xFF;
-                    light->current_b = light->color & 0xFF;
-                    light->progress = 0.0f;
-                    light->running = 1;
-                    fprintf(file_effect_rgb_hex, "%06X\n", light->color);
-                }
-            }
-            else
-            {
-                if (light->duration > 0 && light->running > 0)
-                {
-                    const int colorr = light->color2 >> 16 & 0xFF;
-                    const int colorg = light->color2 >> 8 & 0xFF;
-                    const int colorb = light->color2 & 0xFF;
-                    const float speed = (5000 / light->duration) * 1;
-                    // FadeToBlack(&light->current_r, &light->current_g, &light->current_b, light->progress);
-                    if (light->current_r > colorr)
-                    {
-                        light->current_r = light->current_r - speed;
-                    }
-                    if (light->current_g > colorg)
-                    {
-                        light->current_g = light->current_g - speed;
-                    }
-                    if (light->current_b > colorb)
-                    {
-                        light->current_b = light->current_b - speed;
-                    }
-                    if (light->current_r < colorr)
-                    {
-                        light->current_r = light->current_r + speed;
-                    }
-                    if (light->current_g < colorg)
-                    {
-                        light->current_g = light->current_g + speed;
-                    }
-                    if (light->current_b < colorb)
-                    {
-                        light->current_b = light->current_b + speed;
-                    }
-                    int faded_color = (light->current_r << 16) | (light->current_g << 8) | light->current_b;
-                    if (light->current_r >= colorr - speed && light->current_g >= colorg - speed && light->current_b >= colorb - speed && light->current_r <= colorr + speed && light->current_g <= colorg + speed && light->current_b <= colorb + speed)
-                    {
-                        light->running = 0;
-                    }
-                    fprintf(file_effect_rgb_hex, "%06X\n", faded_color);
-                }
-                else
-                {
-                    fprintf(file_effect_rgb_hex, "%06X\n", light->color2);
-                    light->running = 0;
-                }
-            }
-        }
-
-        else if (light->effect == 16) // Battery Level
-        {
-            BatteryLevelToColor(light, &r, &g, &b);
-
-            // int LED_COUNT = 23;
-            // for (int j = 0; j < LED_COUNT; j++)
-            // {
-            //     light->colorarray[j] = (r << 16) | (g << 8) | b;
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            // }
-
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-
-        else if (light->effect == 17) // CPU Speed
-        {
-            CpuSpeedToColor(light, &r, &g, &b);
-
-            // int LED_COUNT = 23;
-            // for (int j = 0; j < LED_COUNT; j++)
-            // {
-            //     light->colorarray[j] = (r << 16) | (g << 8) | b;
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            // }
-
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-
-        else if (light->effect == 18) // CPU Temperature
-        {
-            CpuTempToColor(light, &r, &g, &b);
-
-            // int LED_COUNT = 23;
-            // for (int j = 0; j < LED_COUNT; j++)
-            // {
-            //     light->colorarray[j] = (r << 16) | (g << 8) | b;
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            // }
-
-            fprintf(file_effect_rgb_hex, "%02X%02X%02X\n", r, g, b);
-        }
-
-        else if (light->effect == 19) // Ambilight
-        {
-            update_ambilight(light);
-
-            // No need to write to file/file_frame_hex
-            fclose(file_effect_rgb_hex);
-            fclose(file_frame_hex);
-            chmodfile(filepath, 0);
-            chmodfile(filepath2, 0);
-            return;
-        }
-
-        else if (light->effect == 20) // Nothing
-        {
-            // Do nothing: leave it to another external process
-            fclose(file_effect_rgb_hex);
-            fclose(file_frame_hex);
-
-            // chmodfile(filepath, 0);
-            // chmodfile(filepath2, 0);
-            return;
-        }
-        else if (light->effect == 21) // Rainbow Snake
-        {
-            fprintf(file_frame_hex, "000000 ");
-            ColorWave(light->progress, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.1, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.2, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.3, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.4, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //////////// mirror rotation / symetry  //////////
-            ColorWave(light->progress + 0.3, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.2, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.1, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            ColorWave(light->progress + 0.4, &r, &g, &b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //////////// same rotation //////////
-            //  ColorWave(light->progress, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.1, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.2, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.3, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.4, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            /////////// inverted position ///////////
-
-            //     ColorWave(light->progress + 0.4, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.3, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.2, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress + 0.1, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-
-            //     ColorWave(light->progress, &r, &g, &b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-            //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
-        }
-        else if (light->effect == 22) // Rotation
-        {
-            int LED_COUNT = 23;
-            // static int current_i = 1; // Starts at 1, because 0 is reserved
-
-            int current_i = ((int)(light->progress * 11.0f)) % 11 + 1; // use speed instead of standard increment
-
-            // Every leds to black
-            for (int j = 0; j < LED_COUNT; j++)
-            {
-                light->colorarray[j] = 0x000000;
-            }
-
-            // Never touch colorarray[0].
-            if (current_i < 12)
-            {
-                light->colorarray[current_i] = light->color;      // left stick (1 to 11)
-                light->colorarray[current_i + 11] = light->color; // right stick (12 to 22)
-            }
-
-            // Display
-            for (int j = 0; j < LED_COUNT; j++)
-            {
-                fprintf(file_frame_hex, "%06X ", light->colorarray[j]);
-            }
-        }
-        else if (light->effect == 23) // Rotation Mirror
-        {
-
-            int LED_COUNT = 23;
-            // static int current_i = 1; // Starts at 1, because 0 is reserved
-            int current_i = ((int)(light->progress * 11.0f)) % 11 + 1; // use speed instead of standard increment
-
-            // Required offset between the two rotating LEDs
-            int offset = 7; // 1 -> opposite
-
-            // Resets everything to black
-            for (int j = 0; j < LED_COUNT; j++)
-            {
-                light->colorarray[j] = 0x000000;
-            }
-
-            // Index calculation for opposite LED with offset
-            int opposite_i = 23 - current_i + offset;
-
-            // Clamp to stay within valid limits [12..22]
-            if (opposite_i >= LED_COUNT)
-                opposite_i -= 11; // loops back to [12..22].
-            if (opposite_i < 12)
-                opposite_i += 11;
-
-            // Apply colors
-            if (current_i < 12)
-            {
-                light->colorarray[current_i] = light->color;
-                light->colorarray[opposite_i] = light->color;
-            }
-
-            // Display
-            for (int j = 0; j < LED_COUNT; j++)
-            {
-                fprintf(file_frame_hex, "%06X ", light->colorarray[j]);
-            }
-        }
-
-        else if (light->effect == 24) // Directions
-        {
-
-            int LED_COUNT = 23;
-            for (int j = 0; j < LED_COUNT; j++)
-                light->colorarray[j] = 0x000000;
-
-            if (dpad_y < 0) // Up
-            {
-                light->colorarray[9] = light->color;
-                // light->colorarray[10] = light->color;
-                light->colorarray[11] = light->color;
-
-                light->colorarray[20] = light->color;
-                light->colorarray[22] = light->color;
-            }
-            else if (dpad_y > 0) // Down
-            {
-                light->colorarray[4] = light->color;
-                light->colorarray[5] = light->color;
-
-                light->colorarray[15] = light->color;
-                light->colorarray[16] = light->color;
-            }
-
-            if (dpad_x < 0) // Left
-            {
-                light->colorarray[1] = light->color;
-                // light->colorarray[2] = light->color;
-                light->colorarray[3] = light->color;
-
-                light->colorarray[12] = light->color;
-                light->colorarray[14] = light->color;
-            }
-            else if (dpad_x > 0) // Right
-            {
-                light->colorarray[6] = light->color;
-                // light->colorarray[13] = light->color;
-                light->colorarray[8] = light->color;
-
-                light->colorarray[17] = light->color;
-                light->colorarray[19] = light->color;
-            }
-
-            for (int j = 0; j < LED_COUNT; j++)
-            {
-                fprintf(file_frame_hex, "%06X ", light->colorarray[j]);
-            }
-        }
-
-        else
-        {
-            fprintf(file_effect_rgb_hex, "%06X\n", light->color);
-        }
-
-        fclose(file_effect_rgb_hex);
-        fclose(file_frame_hex);
-    }
-
-    chmodfile(filepath, 0);
-    chmodfile(filepath2, 0);
-
-    snprintf(filepath, sizeof(filepath), "%s/effect_cycles_%s", dir, light->name);
-    chmodfile(filepath, 1);
-    file = fopen(filepath, "w");
-    if (file != NULL)
-    {
-        fprintf(file, "%d\n", -1);
-        fclose(file);
-    }
-    chmodfile(filepath, 0);
-
-    snprintf(filepath, sizeof(filepath), "%s/effect_duration_%s", dir, light->name);
-    chmodfile(filepath, 1);
-    file = fopen(filepath, "w");
-    if (file != NULL)
-    {
-        fprintf(file, "%d\n", light->duration);
-        fclose(file);
-    }
-    chmodfile(filepath, 0);
-
-    snprintf(filepath, sizeof(filepath), "%s/effect_%s", dir, light->name);
-    chmodfile(filepath, 1);
-    file = fopen(filepath, "w");
-    if (file != NULL)
-    {
-        fprintf(file, "%d\n", light->effect >= 8 ? light->effect >= 19 ? 0 : 4 : light->effect);
-        // Led controller effect 0 to 7 -> send effect 0 to 7
-        // Led controller effect 8 to 18 -> send effect 4 = static
-        // Led controller effect > 18 -> send effect 0 = no effect
-
-        fclose(file);
-    }
-    chmodfile(filepath, 0);
-}
-
-bool checkIfEffectChanged(LightSettings *light)
-{
-    if (light->effect < 8)
-    {
-        char filepath[256];
-        FILE *file;
-        snprintf(filepath, sizeof(filepath), "/sys/class/led_anim/effect_%s", light->name);
-        file = fopen(filepath, "r");
-        if (file != NULL)
-        {
-            char current_value[20];
-            if (fgets(current_value, sizeof(current_value), file))
-            {
-                int current_effect;
-                sscanf(current_value, "%d", &current_effect);
-                fclose(file);
-                return (light->effect != current_effect);
-            }
-        }
-    }
-    else
-    {
-        if (light->effect != light->last_effect)
-        {
-            light->last_effect = light->effect;
-            return true;
-        }
-        else
-        {
-            return false;
-        }
-    }
-}
-
-int main()
-{
-
-    int fd = open("/dev/input/js0", O_RDONLY | O_NONBLOCK);
-    if (fd < 0)
-    {
-        perror("Failed joystick device");
-    }
-    else
-    {
-        jsopen = 1;
-    }
-
-    LightSettings lights[MAX_LIGHTS] = {0};
-
-    signal(SIGTERM, handle_sigterm);
-    signal(SIGCONT, handle_sigcont);
-    signal(SIGSTOP, handle_sigsleep);
-
-    changePermissions("/sys/class/led_anim", 1);
-
-    if (read_settings("led_daemon.conf", lights, MAX_LIGHTS) != 0)
-    {
-        return 1;
-    }
-
-    while (running)
-    {
-        if (!jsopen)
-        {
-            // Attempt to open the device if it is not already opened
-            fd = open("/dev/input/js0", O_RDONLY | O_NONBLOCK);
-            if (fd < 0)
-            {
-                perror("Failed joystick device");
-            }
-            else
-            {
-                printf("Joystick device opened successfully.\n");
-                jsopen = 1; // Set the flag to indicate the device is opened
-            }
-        }
-
-        struct js_event event;
-        if (read(fd, &event, sizeof(event)) > 0)
-        {
-            if (event.type == JS_EVENT_BUTTON)
-            {
-                pressed = event.value ? true : false;
-                last_pressed = event.number;
-            }
-            else if (event.type == JS_EVENT_AXIS)
-            {
-                last_pressed = 100;
-                // Hat0X (left/right)
-                if (event.number == 6)
-                {
-                    dpad_x = event.value;
-                }
-                // Hat0Y (up/down)
-                else if (event.number == 7)
-                {
-                    dpad_y = event.value;
-                }
-            }
-        }
-
-        if (access("/tmp/led_deamon_live", F_OK) == 0)
-        {
-            if (read_settings("led_daemon.conf", lights, MAX_LIGHTS) != 0)
-            {
-                return 1;
-            }
-        }
-
-        for (int i = 0; i < MAX_LIGHTS; i++)
-        {
-            // Check current effect before updating
-            if (checkIfEffectChanged(&lights[i]))
-            {
-                lights[i].updated = true;
-            }
-
-            if (lights[i].updated || first_run || lights[i].effect >= 8)
-            {
-                if (first_run || lights[i].updated)
-                {
-                    int initialColorArray[10] = {lights[i].color, 0xFF0000, 0xFF0000, 0xFF0000, 0xFF0000, 0x000000, 0x000000, 0x000000, 0x000000, 0x000000};
-                    for (int j = 0; j < 8; j++)
-                    {
-                        lights[i].colorarray[j] = initialColorArray[j];
-                    }
-                }
-                changebrightness("/sys/class/led_anim", lights[0].brightness);
-                update_light_settings(&lights[i], "/sys/class/led_anim");
-                lights[i].updated = false;
-            }
-        }
-
-        first_run = false; // Set to false after the first iteration
-        usleep(50000);
-    }
-    close(fd);
-    printf("Received SIGTERM, exiting color app...\n");
-
-    return 0;
-}
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdarg.h>
+#include <ctype.h>
+#include <math.h>
+#include <SDL2/SDL.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <linux/joystick.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#ifdef LCDAEMON_AUDIO // Audio Spectrum, see there
+#include <alsa/asoundlib.h>
+#include <fftw3.h>
+#endif
+
+#include "ledshm.h"
+#include "lcctl.h"
+
+#define MAX_NAME_LEN 50
+#define FRAME_MS 50 // Software effects advance once per frame
+#define CYCLE_TABLE_BUDGET 65536 // Bytes of serialized frames per light, see cycle tables
+#define REACTIVE_LUT_SIZE 64     // Steps of the Reactive decay, see reactive
+
+typedef struct
+{
+    int effect; // Settings the table was rendered with
+    int duration;
+    uint32_t color;
+    uint32_t color2;
+    char *data; // Serialized frames, entry_size bytes each
+    size_t entry_size;
+    size_t capacity;
+    int frames; // Recorded so far
+    int index;  // Next frame to play, once complete
+    bool frame; // Entries are frame_hex, otherwise effect_rgb_hex
+    bool complete;
+    bool live; // Does not fit in the budget: rendered live until the settings change
+} CycleTable;
+
+enum
+{
+    LAYER_TRANSITION, // Last frame of the previous settings, fading out
+    LAYER_REACTIVE,   // Button presses over effects other than Reactive (triggers=)
+    LAYER_FLASH,      // ledctl flash
+    LAYER_ALERT,      // System alerts (--battery-alert)
+    LAYER_EXTERNAL,   // Frames published by external apps
+    NUM_LAYERS        // Bottom to top, over the effect of the light
+};
+
+enum
+{
+    BLEND_NORMAL, // Alpha over what is below
+    BLEND_ADD,    // Adds its color, scaled by its alpha
+};
+
+typedef struct
+{
+    uint32_t argb[LEDSHM_LED_COUNT]; // 0xAARRGGBB, in frame_hex order
+    int blend;
+    long until_ms; // now_ms() at which the layer goes away, 0 until cleared
+    bool visible;  // Not fully transparent
+} Layer;
+
+typedef struct
+{
+    char name[MAX_NAME_LEN];
+    int effect;
+    int last_effect;
+    int duration;
+    int brightness;
+    uint32_t color;
+    uint32_t color2;
+    bool updated;
+    float progress;
+    int colorarray[24];
+    int trigger;
+    uint32_t triggers;                     // triggers= of led_daemon.conf, overrides trigger when not 0
+    long hit_ms[LEDSHM_LED_COUNT];         // Reactive: last time each LED was lit by its trigger, 0 never
+    uint8_t decay[REACTIVE_LUT_SIZE];      // Reactive: energy by age, over decay_duration ms
+    int decay_duration;
+    Layer layers[NUM_LAYERS]; // Shown over the effect, see compositor
+    unsigned layer_mask;      // Active layers
+    int shown_effect;         // Settings the LEDs show, a change starts a transition
+    uint32_t shown_color;
+    uint32_t shown_color2;
+    uint64_t written_hash; // What was last sent to the driver, to skip unchanged frames
+    int written_effect;    // Driver effect last written, 0 while composited
+    long written_ms;
+    int lowered_effect; // Native effect animating this software effect, 0 when it is ticked (see lower_effect)
+    int lowered_duration;
+    int keyframe_ms;     // --keyframes: duration of the Linear transition to the color sent, 0 when not used
+    long next_update_ms; // Frame at which the next keyframe is due
+    CycleTable cycle;
+
+} LightSettings;
+
+LightSettings *lights = NULL; // One light per [section] of led_daemon.conf
+int num_lights = 0;
+
+bool first_run = true;
+uint32_t held_buttons = 0;    // Triggers held down: bit per js button number, TRIGGER_DPAD
+uint32_t latched_buttons = 0; // Pressed since the last tick, even if already released
+uint32_t latched_dpad_leds = 0;
+
+long stats_started_ms = 0;
+unsigned long stats_ticks = 0;
+unsigned long stats_wakeups = 0;
+unsigned long stats_commands = 0;
+
+float progress = 0.0f;
+
+int current_r;
+int current_g;
+int current_b;
+
+int dpad_x = 0;
+int dpad_y = 0;
+
+int stick_axes[4] = {0};      // Left X, Y, right X, Y: latest value only, whatever the event rate
+bool sticks_moved = false;    // Since the last Stick Tracker frame
+long sticks_rendered_ms = 0;
+
+bool keyframes = false;         // --keyframes: see Keyframes
+int battery_alert_percent = 0; // --battery-alert: red pulse over every light below this battery level, 0 when off
+int transition_ms = 300;       // --transition: crossfade when the settings of a light change, 0 for a hard cut
+
+volatile sig_atomic_t running = 1;
+volatile sig_atomic_t reload_requested = 0; // SIGHUP: sent by launch.sh instead of restarting the daemon
+
+int jsopen = 0; // Flag to keep track of whether the file is open
+
+SharedSettings *shared_settings = NULL; // Settings published by the UI while it is running
+uint32_t shared_settings_seq = 0;
+
+SharedFrameRing *frame_ring = NULL; // Frames published by external apps
+
+SharedPreview *preview = NULL;               // Committed frames, shown live by the UI
+uint32_t committed_frame[LEDSHM_LED_COUNT]; // What the LEDs show now, in frame_hex order
+bool committed_frame_changed = false;
+
+// =========== Paths ===========
+// Every file the daemon touches outside of /dev/shm goes through this table, so that it can run against
+// a sandbox (fake sysfs, FIFOs...) instead of the device. By priority: command line flag, environment
+// variable, then the device path, prefixed with --root / LCDAEMON_ROOT when set.
+
+enum
+{
+    PATH_LED_ANIM,
+    PATH_JOYSTICK,
+    PATH_CONFIG_DIR,
+    PATH_LIVE_FLAG,
+    PATH_BATTERY,
+    PATH_CPUFREQ,
+    PATH_THERMAL,
+    PATH_SHMVAR,
+    PATH_SOCKET,
+    PATH_METRICS,
+    NUM_PATHS
+};
+
+typedef struct
+{
+    const char *flag;
+    const char *env;
+    const char *device;
+    char value[160]; // Leaves room for the file names appended to it
+} DaemonPath;
+
+DaemonPath paths[NUM_PATHS] = {
+    {"--led-anim", "LCDAEMON_LED_ANIM", "/sys/class/led_anim", ""},
+    {"--joystick", "LCDAEMON_JOYSTICK", "/dev/input/js0", ""},
+    {"--config-dir", "LCDAEMON_CONFIG_DIR", "/mnt/SDCARD/System/etc", ""},
+    {"--live-flag", "LCDAEMON_LIVE_FLAG", "/tmp/led_deamon_live", ""},
+    {"--battery", "LCDAEMON_BATTERY", "/sys/class/power_supply/axp2202-battery/capacity", ""},
+    {"--cpufreq", "LCDAEMON_CPUFREQ", "/sys/devices/system/cpu/cpufreq/policy0/cpuinfo_cur_freq", ""},
+    {"--thermal", "LCDAEMON_THERMAL", "/sys/class/thermal/thermal_zone0/temp", ""},
+    {"--shmvar", "LCDAEMON_SHMVAR", "/usr/trimui/bin/shmvar", ""},
+    {"--socket", "LCDAEMON_SOCKET", LCCTL_SOCKET_PATH, ""},
+    {"--metrics", "LCDAEMON_METRICS", "/tmp/lcdaemon.metrics", ""},
+};
+
+#define PATH(id) (paths[id].value)
+
+// Sets a path, false when it is too long: the socket path has to fit in sockaddr_un.sun_path
+bool set_path(int id, const char *prefix, const char *value)
+{
+    size_t limit = id == PATH_SOCKET ? sizeof(((struct sockaddr_un *)0)->sun_path) : sizeof(paths[id].value);
+    int len = snprintf(paths[id].value, sizeof(paths[id].value), "%s%s", prefix, value);
+    if (len < 0 || (size_t)len >= limit)
+    {
+        fprintf(stderr, "%s: %s%s is too long (at most %zu characters)\n", paths[id].flag, prefix, value, limit - 1);
+        return false;
+    }
+    return true;
+}
+
+int configure_paths(int argc, char *argv[])
+{
+    const char *root = getenv("LCDAEMON_ROOT");
+    const char *given[NUM_PATHS] = {NULL};
+    for (int i = 1; i < argc; i += 2)
+    {
+        int id = 0;
+        while (id < NUM_PATHS && strcmp(argv[i], paths[id].flag) != 0)
+            id++;
+        if (strcmp(argv[i], "--fast") == 0 || strcmp(argv[i], "--keyframes") == 0)
+        {
+            i--; // Options without a value
+            continue;
+        }
+        bool option = strcmp(argv[i], "--root") == 0 || strcmp(argv[i], "--record") == 0 || strcmp(argv[i], "--replay") == 0 ||
+                      strcmp(argv[i], "--battery-alert") == 0 || strcmp(argv[i], "--transition") == 0 ||
+                      strcmp(argv[i], "--audio-device") == 0 || strcmp(argv[i], "--audio-wav") == 0;
+        if ((id == NUM_PATHS && !option) || i + 1 >= argc)
+        {
+            fprintf(stderr, "Usage: %s [--keyframes] [--battery-alert PERCENT] [--transition MS] [--audio-device PCM | --audio-wav FILE] [--record FILE | --replay FILE [--fast]] [--root DIR]", argv[0]);
+            for (id = 0; id < NUM_PATHS; id++)
+                fprintf(stderr, " [%s PATH]", paths[id].flag);
+            fprintf(stderr, "\n");
+            return -1;
+        }
+        if (id < NUM_PATHS)
+            given[id] = argv[i + 1];
+        else if (strcmp(argv[i], "--root") == 0)
+            root = argv[i + 1];
+    }
+
+    for (int id = 0; id < NUM_PATHS; id++)
+    {
+        const char *value = given[id] != NULL ? given[id] : getenv(paths[id].env);
+        if (!(value != NULL ? set_path(id, "", value) : set_path(id, root ? root : "", paths[id].device)))
+            return -1;
+    }
+    return 0;
+}
+
+// Reads the first integer of a small sysfs file with a single read()
+int read_int_file(const char *path, int *value)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+
+    char buffer[32];
+    int len = read(fd, buffer, sizeof(buffer) - 1);
+    close(fd);
+    if (len <= 0)
+        return -1;
+    buffer[len] = '\0';
+
+    char *end;
+    long parsed = strtol(buffer, &end, 10);
+    if (end == buffer)
+        return -1;
+    *value = parsed;
+    return 0;
+}
+
+// =========== Clock ===========
+// The daemon reads the time through now_us() / now_ms() only. When a trace is replayed as fast as
+// possible the clock is virtual: it only moves when the main loop jumps to the next frame or event.
+// monotonic_us() is the real time, used to measure how long things take.
+
+bool virtual_clock = false;
+long virtual_now_us = 0;
+long frame_ms = 0; // Scheduled time of the frame being computed
+
+long monotonic_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+long now_us()
+{
+    return virtual_clock ? virtual_now_us : monotonic_us();
+}
+
+long now_ms()
+{
+    return now_us() / 1000;
+}
+
+// =========== Trace ===========
+// --record FILE saves everything the daemon reacts to: joystick events, sensor readings and light
+// settings, with their time. --replay FILE [--fast] feeds them back through the same code instead of
+// the live inputs, at real time or as fast as possible, so the same frames are computed again.
+//
+// File: TraceHeader, then records of a TraceRecord followed by `size` bytes of payload.
+
+#define TRACE_MAGIC "LCTRACE1"
+#define TRACE_VERSION 3
+
+typedef struct
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t seed; // rand() seed of the recorded run
+    int32_t battery_alert_percent; // Options of the recorded run which change its frames, applied again on replay
+    int32_t transition_ms;
+    uint8_t keyframes;
+} TraceHeader;
+
+typedef struct __attribute__((packed))
+{
+    uint32_t time_ms; // Since the start of the recording
+    uint8_t type;
+    uint8_t size;
+} TraceRecord;
+
+enum
+{
+    TRACE_JS_EVENT, // struct js_event
+    TRACE_SENSOR,   // TraceSensor
+    TRACE_LIGHT,    // TraceLight, every time the settings of a light change
+    TRACE_RESYNC,   // No payload: every light is rewritten (first frame, SIGCONT, SIGHUP)
+    TRACE_END,      // No payload: the recording stopped, the replay runs until there
+};
+
+enum
+{
+    SENSOR_BATTERY,
+    SENSOR_CPUFREQ,
+    SENSOR_THERMAL,
+    SENSOR_MAINUI_BRIGHTNESS,
+    SENSOR_LIVE_FLAG,
+    NUM_SENSORS
+};
+
+typedef struct __attribute__((packed))
+{
+    uint8_t sensor;
+    int8_t result; // 0, or -1 when the reading failed
+    int32_t value;
+} TraceSensor;
+
+typedef struct __attribute__((packed))
+{
+    char name[LEDSHM_NAME_LEN];
+    int32_t effect;
+    uint32_t color;
+    uint32_t color2;
+    int32_t duration;
+    int32_t brightness;
+    int32_t trigger;
+    uint32_t triggers;
+    uint32_t flash_color;
+    int32_t flash_ms; // Flash time left, 0 when none
+} TraceLight;
+
+FILE *trace_file = NULL; // Recording
+FILE *replay_file = NULL;
+bool replay_fast = false;
+long trace_start_ms = 0;
+bool trace_dirty = false;
+
+// Last reading of each sensor: recorded only when it changes, returned as is when replaying
+TraceSensor sensors[NUM_SENSORS];
+bool sensor_known[NUM_SENSORS];
+
+void trace_write(int type, const void *payload, int size)
+{
+    if (trace_file == NULL)
+        return;
+    // Stamped with the frame time, so that a replay applies the record in the same frame
+    TraceRecord record = {.time_ms = frame_ms - trace_start_ms, .type = type, .size = size};
+    fwrite(&record, sizeof(record), 1, trace_file);
+    if (size > 0)
+        fwrite(payload, size, 1, trace_file);
+    trace_dirty = true;
+}
+
+void set_sensor(int sensor, int result, int value)
+{
+    if (sensor_known[sensor] && sensors[sensor].result == result && sensors[sensor].value == value)
+        return;
+    sensors[sensor] = (TraceSensor){.sensor = sensor, .result = result, .value = value};
+    sensor_known[sensor] = true;
+    trace_write(TRACE_SENSOR, &sensors[sensor], sizeof(TraceSensor));
+}
+
+// A sensor reading done by the daemon, or the recorded one when replaying
+int read_sensor(int sensor, int *value)
+{
+    if (replay_file != NULL)
+    {
+        if (!sensor_known[sensor] || sensors[sensor].result != 0)
+            return -1;
+        *value = sensors[sensor].value;
+        return 0;
+    }
+
+    static const int sensor_paths[] = {PATH_BATTERY, PATH_CPUFREQ, PATH_THERMAL};
+    int result = read_int_file(PATH(sensor_paths[sensor]), value);
+    set_sensor(sensor, result, result == 0 ? *value : 0);
+    return result;
+}
+
+int start_recording(const char *path)
+{
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    TraceHeader header = {.magic = TRACE_MAGIC, .version = TRACE_VERSION, .seed = monotonic_us(),
+                          .battery_alert_percent = battery_alert_percent, .transition_ms = transition_ms, .keyframes = keyframes};
+    fwrite(&header, sizeof(header), 1, trace_file);
+    srand(header.seed);
+    return 0;
+}
+
+void trace_light(const LightSettings *light)
+{
+    if (trace_file == NULL)
+        return;
+    TraceLight traced = {
+        .effect = light->effect,
+        .color = light->color,
+        .color2 = light->color2,
+        .duration = light->duration,
+        .brightness = light->brightness,
+        .trigger = light->trigger,
+        .triggers = light->triggers,
+    };
+    if (light->layer_mask & (1u << LAYER_FLASH))
+    {
+        traced.flash_color = light->layers[LAYER_FLASH].argb[0] & 0xFFFFFF;
+        traced.flash_ms = light->layers[LAYER_FLASH].until_ms - now_ms();
+    }
+    size_t name_len = strlen(light->name);
+    memcpy(traced.name, light->name, name_len < LEDSHM_NAME_LEN ? name_len : LEDSHM_NAME_LEN);
+    trace_write(TRACE_LIGHT, &traced, sizeof(traced));
+}
+
+// =========== Metrics ===========
+// Counters and log-linear histograms (HDR style: 8 sub-buckets per power of two, so about 12% precision)
+// of the daemon's timings, in microseconds. Everything is updated from the main loop only, the signal
+// handler just raises a flag: no locks. Dumped on SIGUSR1 and every few seconds to PATH_METRICS.
+
+#define HIST_BUCKETS 240 // Up to 2^32 us
+#define METRICS_MAX_EFFECT 32
+#define METRICS_FILE_MS 5000
+#define WRITE_REFRESH_MS 1000 // Unchanged attributes are still rewritten this often, in case something else wrote them
+
+typedef struct
+{
+    uint32_t counts[HIST_BUCKETS];
+    uint64_t total;
+    uint64_t max;
+} Histogram;
+
+enum
+{
+    ATTR_FRAME_HEX,
+    ATTR_RGB_HEX,
+    ATTR_EFFECT,
+    ATTR_DURATION,
+    ATTR_CYCLES,
+    ATTR_MAX_SCALE,
+    NUM_ATTRS
+};
+
+const char *attr_names[NUM_ATTRS] = {"frame_hex", "effect_rgb_hex", "effect", "effect_duration", "effect_cycles", "max_scale"};
+
+typedef struct
+{
+    Histogram tick_jitter;                    // Lateness of each frame against its schedule
+    Histogram render[METRICS_MAX_EFFECT + 1]; // Effect computation, per effect
+    Histogram write[NUM_ATTRS];               // open + write + close of each sysfs attribute
+    Histogram input_to_commit;                // Joystick, UI or config change until the LEDs got it
+    unsigned long deadline_misses;            // Frames dropped because the loop was late
+    unsigned long writes[NUM_ATTRS];
+    unsigned long skipped_writes[NUM_ATTRS]; // Unchanged, not sent to the driver
+    long pending_input_us;                   // Oldest input not committed yet, 0 when none
+    long file_written_ms;
+} Metrics;
+
+Metrics metrics;
+volatile sig_atomic_t metrics_requested = 0;
+
+void histogram_record(Histogram *histogram, long value)
+{
+    uint64_t v = value < 0 ? 0 : value > 0xFFFFFFFFL ? 0xFFFFFFFFL : value;
+    int index = v;
+    if (v >= 8)
+    {
+        int exponent = 63 - __builtin_clzll(v);
+        index = (exponent - 2) * 8 + ((v >> (exponent - 3)) & 7);
+    }
+    histogram->counts[index]++;
+    histogram->total++;
+    if (v > histogram->max)
+        histogram->max = v;
+}
+
+// Lower bound of the bucket holding the given percentile
+long histogram_percentile(const Histogram *histogram, double percentile)
+{
+    uint64_t rank = (uint64_t)(histogram->total * percentile / 100.0);
+    uint64_t seen = 0;
+    for (int index = 0; index < HIST_BUCKETS; index++)
+    {
+        seen += histogram->counts[index];
+        if (seen > rank)
+            return index < 8 ? index : (long)(8 + index % 8) << (index / 8 - 1);
+    }
+    return histogram->max;
+}
+
+void histogram_print(FILE *out, const char *name, const char *label, const Histogram *histogram)
+{
+    if (histogram->total == 0)
+        return;
+    fprintf(out, "%s%s count=%llu p50=%ld p90=%ld p99=%ld max=%llu\n", name, label,
+            (unsigned long long)histogram->total, histogram_percentile(histogram, 50), histogram_percentile(histogram, 90),
+            histogram_percentile(histogram, 99), (unsigned long long)histogram->max);
+}
+
+void metrics_write_done(int attr, long started_us)
+{
+    histogram_record(&metrics.write[attr], monotonic_us() - started_us);
+    metrics.writes[attr]++;
+}
+
+// Input received at the given time, measured until the next frame reaches the LEDs
+void metrics_input(long at_us)
+{
+    if (metrics.pending_input_us == 0)
+        metrics.pending_input_us = at_us;
+}
+
+void metrics_dump(FILE *out)
+{
+    char label[32];
+    fprintf(out, "uptime_ms %ld\n", now_ms() - stats_started_ms);
+    fprintf(out, "ticks %lu\n", stats_ticks);
+    fprintf(out, "deadline_misses %lu\n", metrics.deadline_misses);
+    histogram_print(out, "tick_jitter_us", "", &metrics.tick_jitter);
+    histogram_print(out, "input_to_commit_us", "", &metrics.input_to_commit);
+    for (int effect = 0; effect <= METRICS_MAX_EFFECT; effect++)
+    {
+        snprintf(label, sizeof(label), " effect=%d", effect);
+        histogram_print(out, "render_us", label, &metrics.render[effect]);
+    }
+    for (int attr = 0; attr < NUM_ATTRS; attr++)
+    {
+        snprintf(label, sizeof(label), " attr=%s", attr_names[attr]);
+        histogram_print(out, "write_us", label, &metrics.write[attr]);
+        if (metrics.writes[attr] || metrics.skipped_writes[attr])
+            fprintf(out, "writes attr=%s written=%lu skipped=%lu\n", attr_names[attr], metrics.writes[attr], metrics.skipped_writes[attr]);
+    }
+}
+
+// Replaces the metrics file at once, so that readers never see half of it
+void metrics_write_file()
+{
+    char tmp_path[sizeof(paths[0].value) + 8];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", PATH(PATH_METRICS));
+    FILE *file = fopen(tmp_path, "w");
+    if (file == NULL)
+        return;
+    metrics_dump(file);
+    fclose(file);
+    rename(tmp_path, PATH(PATH_METRICS));
+    metrics.file_written_ms = now_ms();
+}
+
+void handle_sigusr1(int sig)
+{
+    metrics_requested = 1;
+}
+
+void chmodfile(const char *file, int writable)
+{
+    return;
+    struct stat statbuf;
+    if (stat(file, &statbuf) == 0)
+    {
+        mode_t newMode;
+        if (writable)
+        {
+            // Add write permissions for all users
+            newMode = statbuf.st_mode | S_IWUSR | S_IWGRP | S_IWOTH;
+        }
+        else
+        {
+            // Remove write permissions for all users
+            newMode = statbuf.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH);
+        }
+
+        // Apply the new permissions
+        if (chmod(file, newMode) != 0)
+        {
+            printf("chmod error %d %s", writable, file);
+        }
+    }
+    else
+    {
+        printf("stat error %d %s", writable, file);
+    }
+}
+
+void changePermissions(const char *path, int writable)
+{
+
+    DIR *dir;
+    struct dirent *entry;
+
+    // Open the directory
+    if ((dir = opendir(path)) != NULL)
+    {
+        while ((entry = readdir(dir)) != NULL)
+        {
+            // Skip "." and ".." entries
+            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            {
+                continue;
+            }
+
+            // Construct new path
+            char newPath[1024];
+            snprintf(newPath, sizeof(newPath), "%s/%s", path, entry->d_name);
+
+            // Get current permissions
+            struct stat statbuf;
+            if (stat(newPath, &statbuf) == 0)
+            {
+                mode_t newMode;
+                if (writable)
+                {
+                    // Add write permissions for all users
+                    newMode = statbuf.st_mode | S_IWUSR | S_IWGRP | S_IWOTH;
+                }
+                else
+                {
+                    // Remove write permissions for all users
+                    newMode = statbuf.st_mode & ~(S_IWUSR | S_IWGRP | S_IWOTH);
+                }
+
+                // Apply the new permissions
+                if (chmod(newPath, newMode) != 0)
+                {
+                    printf("error chmod\n");
+                }
+            }
+            else
+            {
+                printf("error stat\n");
+            }
+        }
+        closedir(dir);
+    }
+    else
+    {
+        perror("opendir");
+    }
+}
+
+int get_mainui_brightness()
+{
+    static int cached_value = 60; // default value
+    static long last_read = 0;
+
+    long now = now_ms();
+    if (now - last_read >= 5000 && replay_file != NULL)
+    {
+        read_sensor(SENSOR_MAINUI_BRIGHTNESS, &cached_value);
+        last_read = now;
+    }
+    else if (now - last_read >= 5000)
+    {
+        char cmd[256];
+        snprintf(cmd, sizeof(cmd), "%s ledvalue", PATH(PATH_SHMVAR));
+        FILE *fp = popen(cmd, "r");
+        if (fp)
+        {
+            char buffer[32];
+            if (fgets(buffer, sizeof(buffer), fp))
+            {
+                int ui_value = atoi(buffer);
+                cached_value = (ui_value * 60) / 10;
+            }
+            pclose(fp);
+        }
+        set_sensor(SENSOR_MAINUI_BRIGHTNESS, 0, cached_value);
+        last_read = now;
+    }
+
+    return cached_value;
+}
+
+// True while the UI runs (the flag file exists)
+bool live_mode()
+{
+    int live;
+    if (replay_file != NULL)
+        return read_sensor(SENSOR_LIVE_FLAG, &live) == 0 && live;
+
+    live = access(PATH(PATH_LIVE_FLAG), F_OK) == 0;
+    set_sensor(SENSOR_LIVE_FLAG, 0, live);
+    return live;
+}
+
+void changebrightness(const char *dir, int value)
+{
+    char filepath[256];
+    FILE *file;
+
+    if (value == -1) // The brightness is controlled by MainUI
+    {
+        if (live_mode())
+        {
+            value = get_mainui_brightness(); // get from shmvar, cached every 5s
+        }
+        else
+        {
+            // Do not touch max_scale if not running in live mode
+            return;
+        }
+    }
+
+    // Written once per light update: only send it when it changed
+    static int written_value = -1;
+    static long written_ms = 0;
+    if (!first_run && value == written_value && now_ms() - written_ms < WRITE_REFRESH_MS)
+    {
+        metrics.skipped_writes[ATTR_MAX_SCALE]++;
+        return;
+    }
+    written_value = value;
+    written_ms = now_ms();
+
+    // Only one global brightness value for all LEDs on TSP
+    snprintf(filepath, sizeof(filepath), "%s/max_scale", dir);
+    chmodfile(filepath, 1);
+
+    long started_us = monotonic_us();
+    file = fopen(filepath, "w");
+    if (file != NULL)
+    {
+        fprintf(file, "%d\n", value);
+        fclose(file);
+    }
+    metrics_write_done(ATTR_MAX_SCALE, started_us);
+
+    chmodfile(filepath, 0);
+}
+
+void handle_sigterm(int sig)
+{
+    running = 0;
+}
+
+void handle_sighup(int sig)
+{
+    reload_requested = 1;
+}
+
+void handle_sigcont(int sig)
+{
+    changePermissions(PATH(PATH_LED_ANIM), 0);
+    first_run = true;
+}
+void handle_sigsleep()
+{
+    changePermissions(PATH(PATH_LED_ANIM), 1);
+}
+
+long elapsed_us(const struct timespec *since)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1000000L + (now.tv_nsec - since->tv_nsec) / 1000;
+}
+
+// Returns the light named after a [section], creating it the first time the section is seen
+LightSettings *get_light(const char *name)
+{
+    for (int i = 0; i < num_lights; i++)
+    {
+        if (strcmp(lights[i].name, name) == 0)
+            return &lights[i];
+    }
+
+    LightSettings *grown = realloc(lights, (num_lights + 1) * sizeof(LightSettings));
+    if (grown == NULL)
+    {
+        perror("Unable to allocate light");
+        return NULL;
+    }
+    lights = grown;
+
+    LightSettings *light = &lights[num_lights++];
+    memset(light, 0, sizeof(LightSettings));
+    strncpy(light->name, name, MAX_NAME_LEN - 1);
+    light->updated = true;
+    return light;
+}
+
+#define TRIGGER_DPAD (1u << 16) // Other triggers are the js button numbers, in trigger_names order
+
+const char *trigger_names[] = {"B", "A", "Y", "X", "L", "R", "SELECT", "START", "MENU"};
+#define NUM_TRIGGER_BUTTONS (int)(sizeof(trigger_names) / sizeof(trigger_names[0]))
+
+// trigger= as set by the UI: 1 to 9 a single button, 10 all of them, 11 L and R, 12 the D-pad
+uint32_t trigger_mask(int trigger)
+{
+    if (trigger >= 1 && trigger <= NUM_TRIGGER_BUTTONS)
+        return 1u << (trigger - 1);
+    if (trigger == 10)
+        return 0xFFFFFFFF;
+    if (trigger == 11)
+        return 1u << 4 | 1u << 5;
+    if (trigger == 12)
+        return TRIGGER_DPAD;
+    return 0;
+}
+
+// triggers=: any number of button names, e.g. "A+B+DPAD"
+uint32_t parse_triggers(const char *value)
+{
+    uint32_t mask = 0;
+    char copy[64];
+    snprintf(copy, sizeof(copy), "%s", value);
+    for (char *name = strtok(copy, "+, \t\r\n"); name != NULL; name = strtok(NULL, "+, \t\r\n"))
+    {
+        if (strcasecmp(name, "DPAD") == 0)
+            mask |= TRIGGER_DPAD;
+        else if (strcasecmp(name, "ALL") == 0)
+            mask |= 0xFFFFFFFF;
+        for (int button = 0; button < NUM_TRIGGER_BUTTONS; button++)
+        {
+            if (strcasecmp(name, trigger_names[button]) == 0)
+                mask |= 1u << button;
+        }
+    }
+    return mask;
+}
+
+void set_light_value(LightSettings *light, const char *key, const char *value)
+{
+    if (strcmp(key, "effect") == 0)
+    {
+        int effect = strtol(value, NULL, 10);
+        if (light->effect != effect)
+        {
+            printf("effect changed\n");
+            light->effect = effect;
+            light->updated = true;
+        }
+    }
+    else if (strcmp(key, "color") == 0 || strcmp(key, "color2") == 0)
+    {
+        uint32_t color = strtoul(value, NULL, 16);
+        uint32_t *target = key[5] == '2' ? &light->color2 : &light->color;
+        if (*target != color)
+        {
+            *target = color;
+            light->updated = true;
+        }
+    }
+    else
+    {
+        int *target;
+        if (strcmp(key, "duration") == 0)
+            target = &light->duration;
+        else if (strcmp(key, "brightness") == 0)
+            target = &light->brightness;
+        else if (strcmp(key, "trigger") == 0)
+            target = &light->trigger;
+        else if (strcmp(key, "triggers") == 0)
+        {
+            uint32_t triggers = parse_triggers(value);
+            if (light->triggers != triggers)
+            {
+                light->triggers = triggers;
+                light->updated = true;
+            }
+            return;
+        }
+        else
+            return; // maxeffects and unknown keys are only meaningful to the UI
+
+        int temp_value = strtol(value, NULL, 10);
+        if (*target != temp_value)
+        {
+            *target = temp_value;
+            light->updated = true;
+        }
+    }
+}
+
+// Single pass over the file: every line is split once into [section] or key=value
+int read_settings(const char *filename)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", PATH(PATH_CONFIG_DIR), filename);
+
+    struct timespec parse_start;
+    clock_gettime(CLOCK_MONOTONIC, &parse_start);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        perror(path);
+        return 1;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return 1;
+    }
+
+    char *buffer = malloc(st.st_size + 1);
+    if (buffer == NULL)
+    {
+        close(fd);
+        return 1;
+    }
+
+    int len = 0;
+    while (len < st.st_size)
+    {
+        int ret = read(fd, buffer + len, st.st_size - len);
+        if (ret <= 0)
+            break;
+        len += ret;
+    }
+    close(fd);
+    buffer[len] = '\0';
+
+    LightSettings *current_light = NULL;
+    char *line = buffer;
+    while (line != NULL && *line != '\0')
+    {
+        char *next = strchr(line, '\n');
+        if (next != NULL)
+            *next++ = '\0';
+
+        while (isspace((unsigned char)*line))
+            line++;
+
+        if (line[0] == '[')
+        {
+            // Section header: any name is a light, named after its sysfs suffix (effect_<name>)
+            char *close_bracket = strchr(line, ']');
+            current_light = NULL;
+            if (close_bracket != NULL && close_bracket - line - 1 > 0 && close_bracket - line - 1 < MAX_NAME_LEN)
+            {
+                *close_bracket = '\0';
+                current_light = get_light(line + 1);
+            }
+        }
+        else if (current_light != NULL && line[0] != '#' && line[0] != ';')
+        {
+            char *equal = strchr(line, '=');
+            if (equal != NULL)
+            {
+                char *key_end = equal;
+                while (key_end > line && isspace((unsigned char)key_end[-1]))
+                    key_end--;
+                *key_end = '\0';
+
+                char *value = equal + 1;
+                while (isspace((unsigned char)*value))
+                    value++;
+
+                set_light_value(current_light, line, value);
+            }
+        }
+        line = next;
+    }
+
+    free(buffer);
+    printf("Parsed %s in %ld us (%d lights)\n", filename, elapsed_us(&parse_start), num_lights);
+    return 0;
+}
+
+// Watches the settings directory rather than the file, so that editors (and the UI)
+// which write a new file and rename it over the old one are caught as well.
+int watch_settings()
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+    {
+        perror("inotify_init1");
+        return -1;
+    }
+    if (inotify_add_watch(fd, PATH(PATH_CONFIG_DIR), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        perror(PATH(PATH_CONFIG_DIR));
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Drains pending inotify events, returns true when filename was rewritten
+bool settings_file_changed(int fd, const char *filename)
+{
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    bool changed = false;
+    int len;
+
+    while ((len = read(fd, events, sizeof(events))) > 0)
+    {
+        for (char *ptr = events; ptr < events + len;)
+        {
+            struct inotify_event *event = (struct inotify_event *)ptr;
+            if (event->len > 0 && strcmp(event->name, filename) == 0)
+                changed = true;
+            ptr += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    return changed;
+}
+
+// Applies the settings published by the UI in shared memory.
+// Returns 1 when a snapshot was taken (changed or not), 0 when the segment is not available yet.
+int read_shared_settings()
+{
+    if (shared_settings == NULL)
+    {
+        shared_settings = ledshm_settings_open(0);
+        if (shared_settings == NULL)
+            return 0;
+        shared_settings_seq = 0;
+    }
+
+    SharedLightSettings snapshot[LEDSHM_MAX_LIGHTS];
+    int count = ledshm_settings_read(shared_settings, snapshot, LEDSHM_MAX_LIGHTS, &shared_settings_seq);
+    if (count < 0)
+        return 0;
+
+    for (int s = 0; s < count; s++)
+    {
+        for (int i = 0; i < num_lights; i++)
+        {
+            LightSettings *light = &lights[i];
+            if (strncmp(light->name, snapshot[s].name, LEDSHM_NAME_LEN) != 0)
+                continue;
+
+            if (light->effect != snapshot[s].effect)
+            {
+                printf("effect changed\n");
+                light->effect = snapshot[s].effect;
+                light->updated = true;
+            }
+            if (light->color != snapshot[s].color)
+            {
+                light->color = snapshot[s].color;
+                light->updated = true;
+            }
+            if (light->color2 != snapshot[s].color2)
+            {
+                light->color2 = snapshot[s].color2;
+                light->updated = true;
+            }
+            if (light->duration != snapshot[s].duration)
+            {
+                light->duration = snapshot[s].duration;
+                light->updated = true;
+            }
+            if (light->brightness != snapshot[s].brightness)
+            {
+                light->brightness = snapshot[s].brightness;
+                light->updated = true;
+            }
+            if (light->trigger != snapshot[s].trigger)
+            {
+                light->trigger = snapshot[s].trigger;
+                light->updated = true;
+            }
+            snapshot[s].triggers[LEDSHM_TRIGGERS_LEN - 1] = '\0';
+            uint32_t triggers = parse_triggers(snapshot[s].triggers);
+            if (light->triggers != triggers)
+            {
+                light->triggers = triggers;
+                light->updated = true;
+            }
+        }
+    }
+    return 1;
+}
+
+// Function to convert integer hex code to SDL_Color
+SDL_Color HexIntToColor(unsigned int hexValue)
+{
+    SDL_Color color = {0, 0, 0, 255}; // Default to black with full opacity
+
+    // Extract RGB values from the integer hex code
+    color.r = (hexValue >> 16) & 0xFF;
+    color.g = (hexValue >> 8) & 0xFF;
+    color.b = hexValue & 0xFF;
+
+    return color;
+}
+
+void HSVtoRGB(float h, float s, float v, int *r, int *g, int *b)
+{
+    int i = floor(h / 60);
+    float f = h / 60 - i;
+    float p = v * (1 - s);
+    float q = v * (1 - s * f);
+    float t = v * (1 - s * (1 - f));
+    switch (i)
+    {
+    case 0:
+        *r = v * 255;
+        *g = t * 255;
+        *b = p * 255;
+        break;
+    case 1:
+        *r = q * 255;
+        *g = v * 255;
+        *b = p * 255;
+        break;
+    case 2:
+        *r = p * 255;
+        *g = v * 255;
+        *b = t * 255;
+        break;
+    case 3:
+        *r = p * 255;
+        *g = q * 255;
+        *b = v * 255;
+        break;
+    case 4:
+        *r = t * 255;
+        *g = p * 255;
+        *b = v * 255;
+        break;
+    default:
+        *r = v * 255;
+        *g = p * 255;
+        *b = q * 255;
+        break;
+    }
+}
+void CycleBetweenTwoColors(float progress, int r1, int g1, int b1, int r2, int g2, int b2, int *r, int *g, int *b)
+{
+    *r = r1 + (r2 - r1) * progress;
+    *g = g1 + (g2 - g1) * progress;
+    *b = b1 + (b2 - b1) * progress;
+}
+void PulseEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
+{
+    float factor = (sin(progress * 2 * M_PI) + 1) / 2; // Create a sine wave effect
+    *r = base_r * factor;
+    *g = base_g * factor;
+    *b = base_b * factor;
+}
+void GradientShift(float progress, int r1, int g1, int b1, int r2, int g2, int b2, int r3, int g3, int b3, int *r, int *g, int *b)
+{
+    float section = fmod(progress * 3.0, 3.0);
+    if (section < 1)
+    {
+        CycleBetweenTwoColors(section, r1, g1, b1, r2, g2, b2, r, g, b);
+    }
+    else if (section < 2)
+    {
+        CycleBetweenTwoColors(section - 1, r2, g2, b2, r3, g3, b3, r, g, b);
+    }
+    else
+    {
+        CycleBetweenTwoColors(section - 2, r3, g3, b3, r1, g1, b1, r, g, b);
+    }
+}
+
+void TwinkleEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
+{
+    float factor = ((rand() % 100) / 100.0f) * (sin(progress * M_PI * 2) + 1) / 2;
+    *r = base_r * factor;
+    *g = base_g * factor;
+    *b = base_b * factor;
+}
+
+void FireEffect(float progress, int *r, int *g, int *b)
+{
+    float section = fmod(progress * 3.0, 3.0);
+    if (section < 1)
+    {
+        CycleBetweenTwoColors(section, 255, 0, 0, 255, 165, 0, r, g, b); // Red to Orange
+    }
+    else if (section < 2)
+    {
+        CycleBetweenTwoColors(section - 1, 255, 165, 0, 255, 255, 0, r, g, b); // Orange to Yellow
+    }
+    else
+    {
+        CycleBetweenTwoColors(section - 2, 255, 255, 0, 255, 0, 0, r, g, b); // Yellow to Red
+    }
+}
+
+void GlitterEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
+{
+    float factor = ((rand() % 100) / 100.0f) * (sin(progress * M_PI * 2) + 1) / 2;
+    if (rand() % 2)
+    {
+        *r = base_r * factor;
+        *g = base_g * factor;
+        *b = base_b * factor;
+    }
+    else
+    {
+        *r = base_r;
+        *g = base_g;
+        *b = base_b;
+    }
+}
+
+void NeonGlowEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
+{
+    float factor = (sin(progress * M_PI * 2) + 1) / 2;
+    *r = base_r * factor;
+    *g = base_g * factor;
+    *b = base_b * factor;
+}
+
+void FireflyEffect(float progress, int base_r, int base_g, int base_b, int *r, int *g, int *b)
+{
+    float factor = ((rand() % 100) / 100.0f) * (sin(progress * M_PI * 2) + 1) / 2;
+    if (rand() % 2)
+    {
+        *r = base_r * factor;
+        *g = base_g * factor;
+        *b = base_b * factor;
+    }
+    else
+    {
+        *r = 0;
+        *g = 0;
+        *b = 0;
+    }
+}
+
+void AuroraEffect(float progress, int *r, int *g, int *b)
+{
+    float section = fmod(progress * 2.0, 2.0);
+    if (section < 1)
+    {
+        CycleBetweenTwoColors(section, 0, 255, 128, 0, 255, 255, r, g, b); // Green to Cyan
+    }
+    else
+    {
+        CycleBetweenTwoColors(section - 1, 0, 255, 255, 0, 128, 255, r, g, b); // Cyan to Blue
+    }
+}
+
+void ColorWave(float progress, int *r, int *g, int *b)
+{
+    float h = fmod(progress * 360.0, 360.0);
+    float s = 1.0, v = 1.0; // Saturation and brightness are constant
+    HSVtoRGB(h, s, v, r, g, b);
+}
+
+void FadeToBlack(int *r, int *g, int *b, float fadeAmount)
+{
+
+    fadeAmount = fadeAmount * 5.0f;
+    if (fadeAmount < 0)
+        fadeAmount = 0;
+    if (fadeAmount > 1)
+        fadeAmount = 1;
+
+    // Calculate the faded RGB values based on fadeAmount
+    *r = *r * (1 - fadeAmount);
+    *g = *g * (1 - fadeAmount);
+    *b = *b * (1 - fadeAmount);
+}
+
+float mapSpeedToProgress(int speed)
+{
+    float progress;
+    if (speed <= 500)
+    {
+        // Map speed from 0 to 1000 to progress from 0.05 to 0.01
+        float maxSpeedSegment1 = 500.0f;
+        float minSpeedSegment1 = 0.0f;
+        float maxProgressSegment1 = 1.1f;
+        float minProgressSegment1 = 0.1f;
+
+        progress = maxProgressSegment1 - ((speed - minSpeedSegment1) / (maxSpeedSegment1 - minSpeedSegment1)) * (maxProgressSegment1 - minProgressSegment1);
+    }
+    else if (speed <= 1000)
+    {
+        // Map speed from 0 to 1000 to progress from 0.05 to 0.01
+        float maxSpeedSegment1 = 1000.0f;
+        float minSpeedSegment1 = 500.0f;
+        float maxProgressSegment1 = 0.1f;
+        float minProgressSegment1 = 0.01f;
+
+        progress = maxProgressSegment1 - ((speed - minSpeedSegment1) / (maxSpeedSegment1 - minSpeedSegment1)) * (maxProgressSegment1 - minProgressSegment1);
+    }
+    else if (speed <= 4900)
+    {
+        // Map speed from 1000 to 4900 to progress from 0.01 to 0.001
+        float maxSpeedSegment2 = 4900.0f;
+        float minSpeedSegment2 = 1000.0f;
+        float maxProgressSegment2 = 0.01f;
+        float minProgressSegment2 = 0.001f;
+
+        progress = maxProgressSegment2 - ((speed - minSpeedSegment2) / (maxSpeedSegment2 - minSpeedSegment2)) * (maxProgressSegment2 - minProgressSegment2);
+    }
+    else
+    {
+        // Handle out-of-range values gracefully
+        progress = 0.001f; // Assuming the slowest value if speed > 4900
+    }
+
+    return progress;
+}
+
+void shiftColors(int colors[], int size)
+{
+    int last = colors[size - 1];
+    for (int i = size - 1; i > 0; i--)
+    {
+        colors[i] = colors[i - 1];
+    }
+    colors[0] = last;
+}
+
+void BatteryLevelToColor(const LightSettings *light, int *r, int *g, int *b)
+{
+    static float blink_progress = 0.0f;
+    static int last_level = 100;
+    static long last_read_time = 0;
+
+    long now = now_ms();
+    if (now - last_read_time >= 10000)
+    {
+        read_sensor(SENSOR_BATTERY, &last_level);
+        last_read_time = now;
+    }
+
+    if (last_level < 10)
+    {
+        // Flashing with speed linked to duration parameterFlashing with speed linked to duration parameter
+        float blink_step = mapSpeedToProgress(light->duration);
+        blink_progress += blink_step;
+        if (blink_progress >= 1.0f)
+            blink_progress -= 1.0f;
+
+        float blink = (sin(blink_progress * M_PI * 2) + 1) / 2.0f;
+        *r = 255 * blink;
+        *g = 0;
+        *b = 0;
+        return;
+    }
+
+    float pct = last_level / 100.0f;
+    if (pct < 0.25f)
+    {
+        CycleBetweenTwoColors(pct / 0.25f, 255, 0, 0, 255, 69, 0, r, g, b);
+    }
+    else if (pct < 0.5f)
+    {
+        CycleBetweenTwoColors((pct - 0.25f) / 0.25f, 255, 69, 0, 255, 255, 0, r, g, b);
+    }
+    else
+    {
+        CycleBetweenTwoColors((pct - 0.5f) / 0.5f, 255, 255, 0, 0, 255, 0, r, g, b);
+    }
+}
+
+void CpuSpeedToColor(const LightSettings *light, int *r, int *g, int *b)
+{
+    static int last_mhz = 0;
+    static long last_read_time = 0;
+
+    long now = now_ms();
+    if (now - last_read_time >= 1000)
+    {
+        int khz = 0;
+        if (read_sensor(SENSOR_CPUFREQ, &khz) == 0)
+        {
+            last_mhz = khz / 1000;
+        }
+        last_read_time = now;
+    }
+
+    float pct = last_mhz / 2000.0f;
+    if (pct < 0.33f)
+    {
+        CycleBetweenTwoColors(pct / 0.33f, 0, 255, 0, 127, 255, 0, r, g, b); // Green to Chartreuse
+    }
+    else if (pct < 0.66f)
+    {
+        CycleBetweenTwoColors((pct - 0.33f) / 0.33f, 127, 255, 0, 255, 140, 0, r, g, b); // Chartreuse to Orange
+    }
+    else
+    {
+        CycleBetweenTwoColors((pct - 0.66f) / 0.34f, 255, 140, 0, 255, 0, 0, r, g, b); // Orange to Red
+    }
+}
+
+void CpuTempToColor(const LightSettings *light, int *r, int *g, int *b)
+{
+    static int last_temp = 60;
+    static long last_read_time_ms = 0;
+
+    long now = now_ms();
+    if (now - last_read_time_ms >= 1000) // Read every 1s
+    {
+        int temp_raw = 0;
+        if (read_sensor(SENSOR_THERMAL, &temp_raw) == 0)
+        {
+            last_temp = temp_raw / 1000; // convert to °C
+        }
+        last_read_time_ms = now;
+    }
+
+    float pct = (last_temp - 60) / 20.0f; // map 60–80°C → 0.0–1.0
+    if (pct < 0.0f)
+        pct = 0.0f;
+    if (pct > 1.0f)
+        pct = 1.0f;
+
+    if (pct < 0.5f)
+    {
+        // Green → Orange
+        CycleBetweenTwoColors(pct / 0.5f, 0, 255, 0, 255, 165, 0, r, g, b);
+    }
+    else
+    {
+        // Orange → Red
+        CycleBetweenTwoColors((pct - 0.5f) / 0.5f, 255, 165, 0, 255, 0, 0, r, g, b);
+    }
+}
+
+void update_ambilight(const LightSettings *light)
+{
+    static long last_ms = 0;
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    long now_ms = tv.tv_sec * 1000 + tv.tv_usec / 1000;
+
+    int delay_ms = light->duration;
+    if (delay_ms < 200)
+        delay_ms = 200;
+
+    if (now_ms - last_ms < delay_ms)
+        return;
+
+    last_ms = now_ms;
+
+    char cmd[256];
+    snprintf(cmd, sizeof(cmd), "./ambilight_runner.sh %s &", light->name);
+    system(cmd); // Non - blocking call thanks to `&`.
+}
+
+float wastriggered = 0.0f;
+
+#define LOWER_MAX_STEP 0.25f // Progress step per frame above which a pulse is too coarse to hand over
+
+// Software effects which a native driver effect can show as well, with the current settings: the driver
+// is programmed once and the light is no longer ticked. Returns the native effect, 0 when there is none.
+int lower_effect(const LightSettings *light, uint32_t *color, int *duration)
+{
+    *color = light->color;
+    *duration = light->duration;
+    switch (light->effect)
+    {
+    case 9:  // Twinkle
+    case 11: // Glitter
+    case 13: // Firefly
+        // Random dimming of color: nothing to animate when it is black
+        return light->color == 0 ? 4 : 0;
+    case 12: // NeonGlow
+    {
+        if (light->color == 0)
+            return 4;
+        // Sine pulse of color from black: Breathe, over the period of the progress. Progress restarts
+        // from 0 once past 1, so a cycle is floor(1 / step) + 1 frames. Fast speeds only sample a few
+        // points of the pulse, Breathe would look nothing like it.
+        float step = mapSpeedToProgress(light->duration);
+        if (step >= LOWER_MAX_STEP)
+            return 0;
+        *duration = FRAME_MS * ((int)floorf(1.0f / step) + 1);
+        return 2;
+    }
+    case 15: // Reactive
+        // Fades from color to color2 on a press: always the same color when they are equal
+        return light->color == light->color2 ? 4 : 0;
+    default:
+        return 0;
+    }
+}
+
+// =========== Keyframes ===========
+// --keyframes: effects which are piecewise linear in RGB only send the color at the end of the current
+// segment, and let the native Linear effect interpolate to it, instead of sending a color every frame.
+
+#define KEYFRAME_MAX_MS 1000 // At least one keyframe per second, even on long segments
+
+// Linear segments of the effect over a cycle, 0 when it cannot be sent as keyframes
+int keyframe_segments(int effect)
+{
+    switch (effect)
+    {
+    case 8: // Color drift: hue sweep, linear between the primary and secondary colors
+        return 6;
+    case 10: // Fire: red, orange, yellow
+        return 3;
+    case 14: // Aurora: green, cyan, blue
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+// Moves progress to the next keyframe, as many frames ahead as it returns
+int advance_to_keyframe(LightSettings *light, float step)
+{
+    int segments = keyframe_segments(light->effect);
+    float boundary = (floorf(light->progress * segments) + 1) / segments;
+    int frames = ceilf((boundary - light->progress) / step);
+    int before_wrap = (1.0f - light->progress) / step; // Progress wraps to 0 once past 1
+    if (frames > before_wrap)
+        frames = before_wrap;
+    if (frames > KEYFRAME_MAX_MS / FRAME_MS)
+        frames = KEYFRAME_MAX_MS / FRAME_MS;
+
+    if (frames < 1)
+    {
+        light->progress = 0.0f;
+        return 1;
+    }
+    light->progress += frames * step;
+    return frames;
+}
+
+// =========== Committed frame ===========
+// Every color sent to the driver is mirrored into committed_frame, which is published to the preview buffer once per frame.
+
+uint32_t output_frame[LEDSHM_LED_COUNT]; // Next frame_hex: every light puts its LEDs in, sent once per frame
+bool output_frame_dirty = false;
+
+// "m" drives the centre light (LED 0), "lr" both stick rings (LEDs 1 to 22). Other lights have no LEDs in frame_hex.
+bool light_leds(const LightSettings *light, int *first, int *count)
+{
+    if (strcmp(light->name, "m") == 0)
+    {
+        *first = 0;
+        *count = 1;
+        return true;
+    }
+    if (strcmp(light->name, "lr") == 0)
+    {
+        *first = 1;
+        *count = LEDSHM_LED_COUNT - 1;
+        return true;
+    }
+    return false;
+}
+
+void commit_light_color(const LightSettings *light, uint32_t color)
+{
+    int first, count;
+    if (!light_leds(light, &first, &count))
+        return;
+
+    for (int i = first; i < first + count; i++)
+    {
+        if (committed_frame[i] != color)
+        {
+            committed_frame[i] = color;
+            committed_frame_changed = true;
+        }
+    }
+}
+
+void commit_frame(const uint32_t *colors, int first, int count)
+{
+    for (int i = first; i < first + count && i < LEDSHM_LED_COUNT; i++)
+    {
+        if (committed_frame[i] != colors[i])
+        {
+            committed_frame[i] = colors[i];
+            committed_frame_changed = true;
+        }
+    }
+}
+
+// Serializes the 23 LED colors in the driver's "RRGGBB RRGGBB ... " format, returns its length
+int format_frame_hex(char *buffer, const uint32_t *colors)
+{
+    static const char hex[] = "0123456789ABCDEF";
+    char *out = buffer;
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+    {
+        for (int shift = 20; shift >= 0; shift -= 4)
+            *out++ = hex[(colors[i] >> shift) & 0xF];
+        *out++ = ' ';
+    }
+    return out - buffer;
+}
+
+// Sends output_frame with a single write(), when a light changed its LEDs this frame
+void flush_output_frame(const char *dir)
+{
+    if (!output_frame_dirty)
+        return;
+    output_frame_dirty = false;
+
+    char buffer[LEDSHM_LED_COUNT * 7];
+    int len = format_frame_hex(buffer, output_frame);
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), "%s/frame_hex", dir);
+
+    long started_us = monotonic_us();
+    int fd = open(filepath, O_WRONLY);
+    if (fd >= 0)
+    {
+        write(fd, buffer, len);
+        close(fd);
+    }
+    metrics_write_done(ATTR_FRAME_HEX, started_us);
+}
+
+void publish_committed_frame()
+{
+    if (preview != NULL && committed_frame_changed)
+        ledshm_preview_publish(preview, committed_frame);
+    committed_frame_changed = false;
+}
+
+// Output of effect_rgb_hex and frame_hex: effects put their colors here, which are serialized once,
+// sent with a single write() and mirrored into committed_frame
+typedef struct
+{
+    char path[256];
+    bool frame; // frame_hex: one color per LED, otherwise one color for the whole light
+    uint32_t colors[LEDSHM_LED_COUNT];
+    int count;
+} LedOutput;
+
+void open_led_output(LedOutput *output, const char *path, bool frame)
+{
+    snprintf(output->path, sizeof(output->path), "%s", path);
+    output->frame = frame;
+    output->count = 0;
+}
+
+// Adds the color of the next LED, or of the whole light
+void put_led_color(LedOutput *output, uint32_t color)
+{
+    if (output->count < LEDSHM_LED_COUNT)
+        output->colors[output->count++] = color;
+}
+
+uint32_t rgb_color(int r, int g, int b)
+{
+    return (uint32_t)r << 16 | (uint32_t)g << 8 | (uint32_t)b;
+}
+
+// Sends what the effect rendered with a single write(), and mirrors it into committed_frame.
+// frame_hex is shared by every light: only the LEDs of the light are taken, output_frame is sent after all the lights.
+void send_led_output(const LedOutput *output, const LightSettings *light)
+{
+    if (output->count == 0)
+        return;
+
+    if (output->frame)
+    {
+        int first = 0, leds = LEDSHM_LED_COUNT; // Lights without LEDs of their own still send the whole frame
+        light_leds(light, &first, &leds);
+        if (first + leds > output->count)
+            leds = output->count - first;
+        for (int i = first; i < first + leds; i++)
+            output_frame[i] = output->colors[i];
+        output_frame_dirty = true;
+        commit_frame(output->colors, first, leds);
+        return;
+    }
+
+    char buffer[16];
+    int len = snprintf(buffer, sizeof(buffer), "%06X\n", output->colors[0]);
+    long started_us = monotonic_us();
+    int fd = open(output->path, O_WRONLY);
+    if (fd >= 0)
+    {
+        write(fd, buffer, len);
+        close(fd);
+    }
+    metrics_write_done(ATTR_RGB_HEX, started_us);
+
+    commit_light_color(light, output->colors[0]);
+}
+
+void write_light_attr(const char *dir, const char *attr, const char *name, const char *format, ...)
+{
+    char filepath[256];
+    snprintf(filepath, sizeof(filepath), "%s/%s_%s", dir, attr, name);
+
+    long started_us = monotonic_us();
+    FILE *file = fopen(filepath, "w");
+    if (file != NULL)
+    {
+        va_list args;
+        va_start(args, format);
+        vfprintf(file, format, args);
+        va_end(args);
+        fclose(file);
+    }
+
+    for (int i = 0; i < NUM_ATTRS; i++)
+    {
+        if (strcmp(attr, attr_names[i]) == 0)
+            metrics_write_done(i, started_us);
+    }
+}
+
+// =========== Compositor ===========
+// Lights can have layers over their effect: flashes, system alerts, frames of external apps. A layer is
+// an ARGB color per LED with a blend mode, active until it expires or is cleared. A light without any
+// active layer sends its effect as before, native driver effects included. Otherwise the colors of its
+// effect are only the base: the visible layers are blended over it in one pass, and the result is shown
+// through frame_hex (driver effect 0). The native effects 1 to 7 are then rendered in software.
+
+#define BATTERY_ALERT_PERIOD_MS 2000
+
+void set_layer(LightSettings *light, int id, int blend, const uint32_t *argb, long until_ms)
+{
+    int first, count;
+    if (!light_leds(light, &first, &count))
+        return; // Nothing to composite into
+
+    Layer *layer = &light->layers[id];
+    memcpy(layer->argb, argb, sizeof(layer->argb));
+    layer->blend = blend;
+    layer->until_ms = until_ms;
+    layer->visible = false;
+    for (int i = first; i < first + count; i++)
+    {
+        if (argb[i] >> 24)
+            layer->visible = true;
+    }
+    light->layer_mask |= 1u << id;
+}
+
+void fill_layer(LightSettings *light, int id, int blend, uint32_t argb, long until_ms)
+{
+    uint32_t colors[LEDSHM_LED_COUNT];
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+        colors[i] = argb;
+    set_layer(light, id, blend, colors, until_ms);
+}
+
+void clear_layer(LightSettings *light, int id)
+{
+    if (!(light->layer_mask & (1u << id)))
+        return;
+    light->layer_mask &= ~(1u << id);
+    light->updated = true; // Show what was below again
+}
+
+void expire_layers(LightSettings *light)
+{
+    long now = now_ms();
+    for (int id = 0; id < NUM_LAYERS; id++)
+    {
+        if ((light->layer_mask & (1u << id)) && light->layers[id].until_ms != 0 && now >= light->layers[id].until_ms)
+            light->layer_mask &= ~(1u << id);
+    }
+}
+
+// Layers with something to show: a light is only composited (driver effect 0) while it has one
+bool layers_visible(const LightSettings *light)
+{
+    for (int id = 0; id < NUM_LAYERS; id++)
+    {
+        if ((light->layer_mask & (1u << id)) && light->layers[id].visible)
+            return true;
+    }
+    return false;
+}
+
+uint32_t blend_pixel(uint32_t below, uint32_t argb, int blend)
+{
+    uint32_t alpha = argb >> 24;
+    if (alpha == 0)
+        return below;
+    if (alpha == 0xFF && blend == BLEND_NORMAL)
+        return argb & 0xFFFFFF;
+
+    uint32_t weight = alpha + (alpha >> 7); // Q8: 0 to 256
+    uint32_t result = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        uint32_t a = (below >> shift) & 0xFF;
+        uint32_t b = (argb >> shift) & 0xFF;
+        uint32_t c = blend == BLEND_ADD ? a + ((b * weight) >> 8) : (a * (256 - weight) + b * weight) >> 8;
+        result |= (c > 0xFF ? 0xFF : c) << shift;
+    }
+    return result;
+}
+
+// Color of a native driver effect (1 to 7) at frame_ms, for lights composited without driver effect.
+// Same curves as the driver (see fakeleds). Linear holds its color, the change itself is crossfaded.
+uint32_t native_effect_color(const LightSettings *light)
+{
+    int period = light->duration > 0 ? light->duration : 1;
+    float phase = (float)(frame_ms % period) / period;
+    float level;
+    switch (light->effect)
+    {
+    case 2: // Breathe
+        level = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * phase);
+        break;
+    case 3: // Interval Breathe: one breath, then a pause as long
+        level = phase < 0.5f ? 0.5f - 0.5f * cosf(4.0f * (float)M_PI * phase) : 0.0f;
+        break;
+    case 5: // Blink 1
+        level = phase < 0.5f ? 1.0f : 0.0f;
+        break;
+    case 6: // Blink 2
+        level = (phase < 0.1f || (phase >= 0.2f && phase < 0.3f)) ? 1.0f : 0.0f;
+        break;
+    case 7: // Blink 3
+        level = (phase < 0.1f || (phase >= 0.2f && phase < 0.3f) || (phase >= 0.4f && phase < 0.5f)) ? 1.0f : 0.0f;
+        break;
+    default: // 1 Linear, 4 Static
+        return light->color;
+    }
+
+    uint32_t color = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+        color |= (uint32_t)(((light->color >> shift) & 0xFF) * level) << shift;
+    return color;
+}
+
+// Blends the visible layers over what the effect rendered, and replaces the outputs with the resulting frame
+void composite_light(LightSettings *light, LedOutput *rgb_output, LedOutput *frame_output)
+{
+    int first = 0, count = 0;
+    light_leds(light, &first, &count);
+
+    const LedOutput *base = frame_output->count > 0 ? frame_output : rgb_output;
+    uint32_t colors[LEDSHM_LED_COUNT];
+    memcpy(colors, output_frame, sizeof(colors)); // LEDs of the other lights are left as they are
+    for (int i = first; i < first + count; i++)
+    {
+        uint32_t color = 0;
+        if (base->frame && i < base->count)
+            color = base->colors[i];
+        else if (!base->frame && base->count > 0)
+            color = base->colors[0];
+
+        for (int id = 0; id < NUM_LAYERS; id++)
+        {
+            const Layer *layer = &light->layers[id];
+            if ((light->layer_mask & (1u << id)) && layer->visible)
+                color = blend_pixel(color, layer->argb[i], layer->blend);
+        }
+        colors[i] = color;
+    }
+
+    rgb_output->count = 0;
+    memcpy(frame_output->colors, colors, sizeof(colors));
+    frame_output->count = LEDSHM_LED_COUNT;
+}
+
+// Crossfade from what the LEDs show to new settings: the committed frame becomes a layer over the new
+// effect, and its alpha goes down to 0 over transition_ms. No write is added: the light is composited
+// through frame_hex like any light with layers.
+void start_transition(LightSettings *light)
+{
+    if (transition_ms <= 0 || first_run || light->effect == 19)
+        return;
+    uint32_t argb[LEDSHM_LED_COUNT];
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+        argb[i] = 0xFF000000 | committed_frame[i];
+    set_layer(light, LAYER_TRANSITION, BLEND_NORMAL, argb, now_ms() + transition_ms);
+}
+
+void fade_transition(LightSettings *light)
+{
+    if (!(light->layer_mask & (1u << LAYER_TRANSITION)))
+        return;
+    Layer *layer = &light->layers[LAYER_TRANSITION];
+    long left = layer->until_ms - now_ms();
+    uint32_t alpha = left <= 0 ? 0 : left >= transition_ms ? 0xFF : (uint32_t)((left << 8) / transition_ms);
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+        layer->argb[i] = alpha << 24 | (layer->argb[i] & 0xFFFFFF);
+    layer->visible = alpha > 0;
+}
+
+// System alert layer: a red pulse over every light while the battery is low
+void update_battery_alert()
+{
+    static int level = 100;
+    static long last_read_time = 0;
+    if (battery_alert_percent <= 0)
+        return;
+
+    long now = now_ms();
+    if (last_read_time == 0 || now - last_read_time >= 10000)
+    {
+        read_sensor(SENSOR_BATTERY, &level);
+        last_read_time = now;
+    }
+
+    float phase = (float)(frame_ms % BATTERY_ALERT_PERIOD_MS) / BATTERY_ALERT_PERIOD_MS;
+    uint32_t alpha = 255 * (0.5f - 0.5f * cosf(phase * 2 * M_PI));
+    for (int i = 0; i < num_lights; i++)
+    {
+        if (level < battery_alert_percent)
+            fill_layer(&lights[i], LAYER_ALERT, BLEND_NORMAL, alpha << 24 | 0xFF0000, 0);
+        else
+            clear_layer(&lights[i], LAYER_ALERT);
+    }
+}
+
+// =========== Reactive ===========
+// Reactive (15): each trigger lights up its own region of LEDs with color, which then fades back to
+// color2. Every LED keeps the time it was last lit; its energy is looked up by age in a decay table built
+// from the duration of the light (exponential, about 1% left after duration ms), so the fade follows the
+// real time whatever the frame rate. Lights with a single LED (m) are lit by any of their triggers.
+// A light with any other effect and an explicit triggers= key shows its presses the same way, in color,
+// as a layer over its effect.
+
+#define LEDS(first, last) ((1u << ((last) + 1)) - (1u << (first))) // frame_hex indexes, as a bitmask
+
+// Face buttons light the matching side of the right ring, shoulders the top of their ring
+const uint32_t button_regions[NUM_TRIGGER_BUTTONS] = {
+    LEDS(15, 16), // B
+    LEDS(17, 19), // A
+    LEDS(12, 14), // Y
+    LEDS(20, 22), // X
+    LEDS(9, 11),  // L
+    LEDS(20, 22), // R
+    LEDS(1, 22),  // SELECT
+    LEDS(1, 22),  // START
+    LEDS(1, 22),  // MENU
+};
+
+// The D-pad lights the matching side of the left ring
+uint32_t dpad_region(int x, int y)
+{
+    uint32_t leds = 0;
+    if (y < 0)
+        leds |= LEDS(9, 11);
+    else if (y > 0)
+        leds |= LEDS(4, 5);
+    if (x < 0)
+        leds |= LEDS(1, 3);
+    else if (x > 0)
+        leds |= LEDS(6, 8);
+    return leds;
+}
+
+uint32_t reactive_triggers(const LightSettings *light)
+{
+    return light->triggers != 0 ? light->triggers : trigger_mask(light->trigger);
+}
+
+void build_decay_table(LightSettings *light)
+{
+    for (int i = 0; i < REACTIVE_LUT_SIZE; i++)
+        light->decay[i] = i == REACTIVE_LUT_SIZE - 1 ? 0 : (uint8_t)(255.0f * expf(-5.0f * i / REACTIVE_LUT_SIZE) + 0.5f);
+    light->decay_duration = light->duration;
+}
+
+// Q8 mix from color2 (energy 0) to color (energy 255)
+uint32_t mix_light_colors(const LightSettings *light, int energy)
+{
+    int weight = energy + (energy >> 7);
+    uint32_t result = 0;
+    for (int shift = 0; shift < 24; shift += 8)
+    {
+        int from = (light->color2 >> shift) & 0xFF;
+        int to = (light->color >> shift) & 0xFF;
+        result |= (uint32_t)(from + (((to - from) * weight) >> 8)) << shift;
+    }
+    return result;
+}
+
+// Lights up the regions of the triggers pressed since the last frame, and fills energy (0 to 255) for
+// the LEDs of the light, 0 elsewhere. Single LED lights only use energy[0]. Returns the number of LEDs lit.
+int reactive_energy(LightSettings *light, int *energy, bool *ring)
+{
+    if (light->decay_duration != light->duration)
+        build_decay_table(light);
+
+    int first, count;
+    *ring = light_leds(light, &first, &count) && count > 1;
+    if (!*ring)
+    {
+        first = 0;
+        count = 1;
+    }
+
+    uint32_t triggers = (held_buttons | latched_buttons) & reactive_triggers(light);
+    uint32_t leds = 0;
+    for (int button = 0; button < NUM_TRIGGER_BUTTONS; button++)
+    {
+        if (triggers & (1u << button))
+            leds |= button_regions[button];
+    }
+    if (triggers & TRIGGER_DPAD)
+        leds |= dpad_region(dpad_x, dpad_y) | latched_dpad_leds;
+    if (!*ring)
+        leds = triggers ? 1u : 0;
+
+    long now = now_ms();
+    int duration = light->duration > 0 ? light->duration : 1;
+    int lit = 0;
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+        energy[i] = 0;
+    for (int i = first; i < first + count; i++)
+    {
+        if (leds & (1u << i))
+            light->hit_ms[i] = now;
+
+        if (light->hit_ms[i] != 0)
+        {
+            long step = (now - light->hit_ms[i]) * REACTIVE_LUT_SIZE / duration;
+            if (step < REACTIVE_LUT_SIZE)
+                energy[i] = light->decay[step];
+            else
+                light->hit_ms[i] = 0; // Faded out
+        }
+        if (energy[i] > 0)
+            lit++;
+    }
+    return lit;
+}
+
+void render_reactive(LightSettings *light, LedOutput *rgb_output, LedOutput *frame_output)
+{
+    int energy[LEDSHM_LED_COUNT];
+    bool ring;
+    reactive_energy(light, energy, &ring);
+
+    if (!ring)
+    {
+        put_led_color(rgb_output, mix_light_colors(light, energy[0]));
+        return;
+    }
+    int first = 0, count = 0;
+    light_leds(light, &first, &count);
+    for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+        put_led_color(frame_output, i >= first && i < first + count ? mix_light_colors(light, energy[i]) : 0);
+}
+
+// Presses over the other effects: color with the energy of each LED as alpha, cleared once faded out
+void update_reactive_layers()
+{
+    for (int i = 0; i < num_lights; i++)
+    {
+        LightSettings *light = &lights[i];
+        if (light->effect == 15 || light->triggers == 0)
+        {
+            clear_layer(light, LAYER_REACTIVE);
+            continue;
+        }
+
+        int energy[LEDSHM_LED_COUNT];
+        bool ring;
+        if (reactive_energy(light, energy, &ring) == 0)
+        {
+            clear_layer(light, LAYER_REACTIVE);
+            continue;
+        }
+        uint32_t argb[LEDSHM_LED_COUNT];
+        for (int j = 0; j < LEDSHM_LED_COUNT; j++)
+            argb[j] = (uint32_t)energy[j] << 24 | (light->color & 0xFFFFFF);
+        set_layer(light, LAYER_REACTIVE, BLEND_NORMAL, argb, 0);
+    }
+}
+
+// =========== Stick tracker ===========
+// Stick Tracker (25): each ring points where its stick points, brighter the further it is pushed. The
+// position falls between two LEDs, which share the intensity (anti-aliasing). Motion is rendered as it
+// arrives, but at most once per STICK_FRAME_MS: a burst of axis events only keeps its latest vector.
+
+#define STICK_FRAME_MS 16
+#define STICK_DEADZONE 0.12f
+
+// Angle of ring LED k (1 to 11), counterclockwise from the right: 2 is on the left, 10 at the top (as in fakeleds)
+float ring_position(float degrees)
+{
+    float position = (degrees - 180.0f) * 11.0f / 360.0f + 1.0f; // 0-based: LED k is at k - 1
+    position = fmodf(position, 11.0f);
+    return position < 0 ? position + 11.0f : position;
+}
+
+// Energy of the 11 LEDs of a ring, from one stick
+void track_stick(int x, int y, int *energy)
+{
+    for (int k = 0; k < 11; k++)
+        energy[k] = 0;
+
+    float dx = x / 32767.0f;
+    float dy = -y / 32767.0f; // Axes grow downwards
+    float magnitude = sqrtf(dx * dx + dy * dy);
+    if (magnitude < STICK_DEADZONE)
+        return;
+    magnitude = magnitude > 1.0f ? 1.0f : (magnitude - STICK_DEADZONE) / (1.0f - STICK_DEADZONE);
+
+    float position = ring_position(atan2f(dy, dx) * 180.0f / (float)M_PI);
+    int led = (int)position;
+    float fraction = position - led;
+    energy[led % 11] = (int)(255 * magnitude * (1.0f - fraction) + 0.5f);
+    energy[(led + 1) % 11] = (int)(255 * magnitude * fraction + 0.5f);
+}
+
+void render_stick_tracker(LightSettings *light, LedOutput *frame_output)
+{
+    int left[11], right[11];
+    track_stick(stick_axes[0], stick_axes[1], left);
+    track_stick(stick_axes[2], stick_axes[3], right);
+
+    int first, count;
+    if (!light_leds(light, &first, &count) || count == 1)
+    {
+        // A single LED: as bright as the stick pushed the most. Sent as a frame, the effect has no driver effect.
+        int left_energy = 0, right_energy = 0; // The two LEDs around the position share the magnitude
+        for (int k = 0; k < 11; k++)
+        {
+            left_energy += left[k];
+            right_energy += right[k];
+        }
+        int energy = left_energy > right_energy ? left_energy : right_energy;
+        put_led_color(frame_output, mix_light_colors(light, energy > 255 ? 255 : energy));
+        return;
+    }
+
+    put_led_color(frame_output, 0);
+    for (int k = 0; k < 11; k++)
+        put_led_color(frame_output, mix_light_colors(light, left[k]));
+    for (int k = 0; k < 11; k++)
+        put_led_color(frame_output, mix_light_colors(light, right[k]));
+}
+
+// =========== Audio spectrum ===========
+// Audio Spectrum (26): what is playing, as log-spaced frequency bands over the ring LEDs (left ring the
+// low half, right ring the high half), and its beats on single-LED lights (m). PCM comes from an ALSA
+// capture device, a loopback or monitor of the output (--audio-device), read by its own thread; or from
+// a WAV file (--audio-wav) played along the daemon clock, to test and benchmark without a sound card.
+// Both go through a lock-free ring with a single writer. Each frame takes the latest window from it and
+// runs one real FFT, with a plan made once; lights with this effect are rendered every AUDIO_FRAME_MS.
+// Capture and FFT need ALSA and FFTW: they are only built with -DLCDAEMON_AUDIO (-lfftw3f -lasound),
+// the effect shows silence otherwise.
+
+#define AUDIO_RING_SIZE 16384 // Samples, power of 2: several frames of margin
+#define AUDIO_FFT_SIZE 1024
+#define AUDIO_BANDS 22
+#define AUDIO_MIN_HZ 40.0f
+#define AUDIO_MAX_HZ 16000.0f
+#define AUDIO_FRAME_MS 16
+#define AUDIO_RANGE_DB 45.0f       // Shown below the loudest band
+#define AUDIO_RELEASE_PER_MS 0.002f // Bands fall back in 500 ms
+#define BEAT_HISTORY 64             // Bass energy of the last frames, about one second
+#define BEAT_MAX_HZ 150.0f
+#define AUDIO_WAV_MAX_CHANNELS 8
+#define AUDIO_WAV_MAX_RATE 192000
+#define AUDIO_WAV_MAX_BYTES (64 * 1024 * 1024)
+
+typedef struct
+{
+    int16_t samples[AUDIO_RING_SIZE];
+    _Atomic uint32_t written; // Samples written so far: the only thing shared with the writer
+} AudioRing;
+
+typedef struct
+{
+#ifdef LCDAEMON_AUDIO
+    float *in;
+    fftwf_complex *out;
+    fftwf_plan plan;
+#endif
+    float window[AUDIO_FFT_SIZE];      // Hann
+    int band_bins[AUDIO_BANDS + 1];    // First FFT bin of each band
+    float levels[AUDIO_BANDS];         // 0 to 1
+    float peak_db;                     // Automatic gain
+    float bass_history[BEAT_HISTORY];
+    int bass_index;
+    float beat; // 0 to 1, back to 0 after each beat
+    long beat_ms;
+    long analyzed_ms;
+} AudioAnalysis;
+
+AudioRing audio_ring;
+AudioAnalysis audio;
+const char *audio_device = "default"; // NULL: no capture (silence)
+const char *audio_wav_path = NULL;
+int audio_rate = 44100;
+bool audio_started = false;
+long audio_rendered_ms = 0;
+
+int16_t *audio_wav = NULL; // Whole file, mono
+long audio_wav_length = 0;
+long audio_wav_started_ms = 0;
+long audio_wav_fed = 0;
+
+// Writer side: the capture thread, or the WAV feed
+void audio_ring_push(const int16_t *samples, int count)
+{
+    uint32_t written = atomic_load_explicit(&audio_ring.written, memory_order_relaxed);
+    for (int i = 0; i < count; i++)
+        audio_ring.samples[(written + i) & (AUDIO_RING_SIZE - 1)] = samples[i];
+    atomic_store_explicit(&audio_ring.written, written + count, memory_order_release);
+}
+
+// Reader side: the latest count samples, windowed, as floats (silence before the first samples)
+void audio_ring_latest(float *out, const float *window, int count)
+{
+    uint32_t written = atomic_load_explicit(&audio_ring.written, memory_order_acquire);
+    for (int i = 0; i < count; i++)
+    {
+        uint32_t age = count - i;
+        out[i] = age <= written ? audio_ring.samples[(written - age) & (AUDIO_RING_SIZE - 1)] * window[i] / 32768.0f : 0.0f;
+    }
+}
+
+#ifdef LCDAEMON_AUDIO
+void *audio_capture_thread(void *arg)
+{
+    snd_pcm_t *pcm = NULL;
+    int err = snd_pcm_open(&pcm, audio_device, SND_PCM_STREAM_CAPTURE, 0);
+    if (err >= 0)
+        err = snd_pcm_set_params(pcm, SND_PCM_FORMAT_S16_LE, SND_PCM_ACCESS_RW_INTERLEAVED, 1, audio_rate, 1, 50000);
+    if (err < 0)
+    {
+        fprintf(stderr, "Audio capture %s: %s\n", audio_device, snd_strerror(err));
+        if (pcm != NULL)
+            snd_pcm_close(pcm);
+        return NULL;
+    }
+
+    int16_t buffer[512];
+    while (running)
+    {
+        snd_pcm_sframes_t frames = snd_pcm_readi(pcm, buffer, 512);
+        if (frames < 0 && snd_pcm_recover(pcm, frames, 1) < 0)
+            break;
+        if (frames > 0)
+            audio_ring_push(buffer, frames);
+    }
+    snd_pcm_close(pcm);
+    return NULL;
+}
+#endif
+
+// 16-bit PCM WAV, downmixed to mono. Files longer than AUDIO_WAV_MAX_BYTES of samples are cut there.
+int load_audio_wav(const char *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+
+    char riff[12];
+    int channels = 0, bits = 0;
+    uint32_t rate = 0;
+    if (fread(riff, 1, 12, file) != 12 || memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0)
+    {
+        fprintf(stderr, "%s: not a WAV file\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    unsigned char chunk[8];
+    while (fread(chunk, 1, 8, file) == 8)
+    {
+        uint32_t size = chunk[4] | chunk[5] << 8 | chunk[6] << 16 | (uint32_t)chunk[7] << 24;
+        if (memcmp(chunk, "fmt ", 4) == 0 && size >= 16)
+        {
+            unsigned char format[16];
+            if (fread(format, 1, 16, file) != 16)
+                break;
+            channels = format[2] | format[3] << 8;
+            rate = format[4] | format[5] << 8 | format[6] << 16 | (uint32_t)format[7] << 24;
+            bits = format[14] | format[15] << 8;
+            fseek(file, size - 16 + (size & 1), SEEK_CUR);
+        }
+        else if (memcmp(chunk, "data", 4) == 0)
+        {
+            if (channels < 1 || channels > AUDIO_WAV_MAX_CHANNELS || rate < 1000 || rate > AUDIO_WAV_MAX_RATE || bits != 16)
+                break;
+            if (size > AUDIO_WAV_MAX_BYTES)
+                size = AUDIO_WAV_MAX_BYTES;
+            long frames = size / (2 * channels);
+            int16_t *data = malloc(frames * 2 * channels);
+            audio_wav = malloc(frames * sizeof(int16_t));
+            if (data != NULL && audio_wav != NULL)
+                frames = fread(data, 2 * channels, frames, file); // Streamed files may have less than announced
+            else
+                frames = 0;
+            for (long i = 0; i < frames; i++)
+            {
+                int sum = 0;
+                for (int c = 0; c < channels; c++)
+                    sum += data[i * channels + c];
+                audio_wav[i] = sum / channels;
+            }
+            free(data);
+            audio_wav_length = frames;
+            break;
+        }
+        else
+        {
+            fseek(file, size + (size & 1), SEEK_CUR);
+        }
+    }
+    fclose(file);
+
+    if (audio_wav_length == 0)
+    {
+        fprintf(stderr, "%s: no 16-bit PCM data (1 to %d channels, 1000 to %d Hz)\n", path, AUDIO_WAV_MAX_CHANNELS, AUDIO_WAV_MAX_RATE);
+        free(audio_wav);
+        audio_wav = NULL;
+        return -1;
+    }
+    audio_rate = rate;
+    return 0;
+}
+
+// Pushes the samples of the WAV file due by now, looping over it
+void feed_audio_wav()
+{
+    long due = (now_ms() - audio_wav_started_ms) * audio_rate / 1000;
+    if (due - audio_wav_fed > AUDIO_RING_SIZE / 2)
+        audio_wav_fed = due - AUDIO_RING_SIZE / 2; // Far behind: skip what would be overwritten anyway
+    while (audio_wav_fed < due)
+    {
+        long offset = audio_wav_fed % audio_wav_length;
+        long count = due - audio_wav_fed;
+        if (count > audio_wav_length - offset)
+            count = audio_wav_length - offset;
+        audio_ring_push(audio_wav + offset, count);
+        audio_wav_fed += count;
+    }
+}
+
+#ifdef LCDAEMON_AUDIO
+void start_audio()
+{
+    audio_started = true;
+    if (audio_wav_path != NULL)
+    {
+        if (load_audio_wav(audio_wav_path) == 0)
+            audio_wav_started_ms = now_ms();
+    }
+    else if (audio_device != NULL)
+    {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, audio_capture_thread, NULL) == 0)
+            pthread_detach(thread);
+    }
+
+    audio.in = fftwf_malloc(sizeof(float) * AUDIO_FFT_SIZE);
+    audio.out = fftwf_malloc(sizeof(fftwf_complex) * (AUDIO_FFT_SIZE / 2 + 1));
+    audio.plan = fftwf_plan_dft_r2c_1d(AUDIO_FFT_SIZE, audio.in, audio.out, FFTW_ESTIMATE);
+    for (int i = 0; i < AUDIO_FFT_SIZE; i++)
+        audio.window[i] = 0.5f - 0.5f * cosf(2.0f * (float)M_PI * i / (AUDIO_FFT_SIZE - 1));
+
+    // Log-spaced bands, at least one bin each
+    float ratio = powf(AUDIO_MAX_HZ / AUDIO_MIN_HZ, 1.0f / AUDIO_BANDS);
+    for (int band = 0; band <= AUDIO_BANDS; band++)
+    {
+        int bin = (int)(AUDIO_MIN_HZ * powf(ratio, band) * AUDIO_FFT_SIZE / audio_rate + 0.5f);
+        if (band > 0 && bin <= audio.band_bins[band - 1])
+            bin = audio.band_bins[band - 1] + 1;
+        audio.band_bins[band] = bin < AUDIO_FFT_SIZE / 2 ? bin : AUDIO_FFT_SIZE / 2;
+    }
+    audio.peak_db = -AUDIO_RANGE_DB;
+}
+
+// Spectrum and beat of the latest window, computed once per frame for every light
+void analyze_audio()
+{
+    if (!audio_started)
+        start_audio();
+    long now = now_ms();
+    if (audio.analyzed_ms == now)
+        return;
+    long elapsed = audio.analyzed_ms == 0 || now - audio.analyzed_ms > 100 ? AUDIO_FRAME_MS : now - audio.analyzed_ms;
+    audio.analyzed_ms = now;
+
+    if (audio_wav != NULL)
+        feed_audio_wav();
+    audio_ring_latest(audio.in, audio.window, AUDIO_FFT_SIZE);
+    fftwf_execute(audio.plan);
+
+    float loudest = -200.0f;
+    for (int band = 0; band < AUDIO_BANDS; band++)
+    {
+        float power = 0.0f;
+        int first = audio.band_bins[band], last = audio.band_bins[band + 1];
+        for (int bin = first; bin < last || bin == first; bin++)
+            power += audio.out[bin][0] * audio.out[bin][0] + audio.out[bin][1] * audio.out[bin][1];
+        float db = 10.0f * log10f(power / (last > first ? last - first : 1) + 1e-12f);
+        loudest = db > loudest ? db : loudest;
+
+        float level = (db - (audio.peak_db - AUDIO_RANGE_DB)) / AUDIO_RANGE_DB;
+        level = level < 0.0f ? 0.0f : level > 1.0f ? 1.0f : level;
+        float released = audio.levels[band] - AUDIO_RELEASE_PER_MS * elapsed;
+        audio.levels[band] = level > released ? level : released; // Up at once, down smoothly
+    }
+    // The gain follows the loudest band, and slowly comes back up in quiet parts
+    audio.peak_db = loudest > audio.peak_db ? loudest : audio.peak_db - 0.01f * elapsed;
+    if (audio.peak_db < -60.0f)
+        audio.peak_db = -60.0f;
+
+    // Beat: bass energy well above its average over the last second
+    float bass = 0.0f;
+    int bass_bins = BEAT_MAX_HZ * AUDIO_FFT_SIZE / audio_rate;
+    for (int bin = 1; bin <= bass_bins; bin++)
+        bass += audio.out[bin][0] * audio.out[bin][0] + audio.out[bin][1] * audio.out[bin][1];
+    float average = 0.0f;
+    for (int i = 0; i < BEAT_HISTORY; i++)
+        average += audio.bass_history[i];
+    average /= BEAT_HISTORY;
+    audio.bass_history[audio.bass_index] = bass;
+    audio.bass_index = (audio.bass_index + 1) % BEAT_HISTORY;
+
+    audio.beat *= expf(-(float)elapsed / 150.0f);
+    if (bass > 1.5f * average && bass > 1e-3f && now - audio.beat_ms > 150)
+    {
+        audio.beat = 1.0f;
+        audio.beat_ms = now;
+    }
+}
+#else
+void analyze_audio()
+{
+    // Built without audio: the levels and the beat stay at 0
+}
+#endif
+
+void render_audio_spectrum(LightSettings *light, LedOutput *frame_output)
+{
+    analyze_audio();
+
+    int first, count;
+    if (!light_leds(light, &first, &count) || count == 1)
+    {
+        // Beats on a single LED, sent as a frame: the effect has no driver effect
+        put_led_color(frame_output, mix_light_colors(light, (int)(255 * audio.beat)));
+        return;
+    }
+
+    put_led_color(frame_output, 0);
+    for (int band = 0; band < AUDIO_BANDS; band++)
+        put_led_color(frame_output, mix_light_colors(light, (int)(255 * audio.levels[band])));
+}
+
+// =========== Cycle tables ===========
+// Periodic effects render the same frames on every cycle: progress restarts from exactly 0 after each
+// wrap. The first cycle after the settings change is rendered live and its colors are kept in the cycle
+// table of the light; the following cycles are played from it, without any maths.
+
+// Effects which only depend on their settings and progress. NeonGlow only gets here at the fast speeds
+// which lower_effect leaves to software.
+bool cycle_table_effect(int effect)
+{
+    return effect == 8 || effect == 10 || effect == 12 || effect == 14 || (effect >= 21 && effect <= 23);
+}
+
+void cycle_table_reset(CycleTable *table)
+{
+    free(table->data);
+    memset(table, 0, sizeof(*table));
+}
+
+// Starts a new table when the settings changed. Returns true when the next frame can be played from it.
+bool cycle_table_ready(LightSettings *light)
+{
+    CycleTable *table = &light->cycle;
+    if (table->effect != light->effect || table->duration != light->duration || table->color != light->color ||
+        table->color2 != light->color2)
+    {
+        cycle_table_reset(table);
+        table->effect = light->effect;
+        table->duration = light->duration;
+        table->color = light->color;
+        table->color2 = light->color2;
+        light->progress = 0.0f; // Record from the start of a cycle
+    }
+    return table->complete;
+}
+
+// Adds the frame just rendered live to the table being recorded
+void cycle_table_record(LightSettings *light, const LedOutput *rgb_output, const LedOutput *frame_output)
+{
+    CycleTable *table = &light->cycle;
+    if (table->complete || table->live)
+        return;
+
+    const LedOutput *output = frame_output->count > 0 ? frame_output : rgb_output;
+    size_t size = output->count * sizeof(uint32_t);
+    if (table->frames == 0)
+    {
+        table->entry_size = size;
+        table->frame = output->frame;
+    }
+    size_t needed = (table->frames + 1) * table->entry_size;
+    if (size == 0 || size != table->entry_size || output->frame != table->frame ||
+        (rgb_output->count > 0 && frame_output->count > 0) || needed > CYCLE_TABLE_BUDGET)
+    {
+        free(table->data);
+        table->data = NULL;
+        table->live = true;
+        return;
+    }
+
+    if (needed > table->capacity)
+    {
+        size_t capacity = table->capacity * 2 > needed ? table->capacity * 2 : needed * 8;
+        if (capacity > CYCLE_TABLE_BUDGET)
+            capacity = CYCLE_TABLE_BUDGET;
+        char *grown = realloc(table->data, capacity);
+        if (grown == NULL)
+        {
+            table->live = true;
+            return;
+        }
+        table->data = grown;
+        table->capacity = capacity;
+    }
+    memcpy(table->data + table->frames * table->entry_size, output->colors, table->entry_size);
+    table->frames++;
+    if (light->progress == 0.0f)
+        table->complete = true; // Progress just wrapped: the cycle is over
+}
+
+// Copies the next frame of the table into the outputs
+void cycle_table_play(LightSettings *light, LedOutput *rgb_output, LedOutput *frame_output)
+{
+    CycleTable *table = &light->cycle;
+    rgb_output->count = 0;
+    frame_output->count = 0;
+    LedOutput *output = table->frame ? frame_output : rgb_output;
+    memcpy(output->colors, table->data + table->index * table->entry_size, table->entry_size);
+    output->count = table->entry_size / sizeof(uint32_t);
+    table->index = (table->index + 1) % table->frames;
+}
+
+uint64_t hash_bytes(uint64_t hash, const void *data, size_t size)
+{
+    const unsigned char *bytes = data;
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ bytes[i]) * 0x100000001B3ULL; // FNV-1a
+    return hash;
+}
+
+// Sends one computed frame of a light to the driver. A frame identical to the previous one is skipped,
+// unless the driver state has to be restored (first frame, settings changed, or refresh due).
+void send_light_update(LightSettings *light, const char *dir, LedOutput *rgb_output, LedOutput *frame_output)
+{
+    int driver_effect = light->effect >= 8 ? light->effect >= 19 || frame_output->count > 0 ? 0 : 4 : light->effect;
+    int duration = light->duration;
+    int cycles = -1;
+    // Led controller effect 0 to 7 -> send effect 0 to 7
+    // Led controller effect 8 to 18 -> send effect 4 = static, or the native effect it was lowered to,
+    //                                  or effect 0 when they draw a frame (Reactive on lr)
+    // Led controller effect > 18 -> send effect 0 = no effect
+    // Visible layers over the effect -> send effect 0, the composited frame_hex shows
+    if (layers_visible(light))
+    {
+        driver_effect = 0;
+    }
+    else if (light->lowered_effect > 0)
+    {
+        driver_effect = light->lowered_effect;
+        duration = light->lowered_duration;
+    }
+    else if (light->keyframe_ms > 0)
+    {
+        // Linear transition from the current color to the keyframe, held until the next one
+        driver_effect = 1;
+        duration = light->keyframe_ms;
+        cycles = 1;
+    }
+
+    uint64_t hash = 0xCBF29CE484222325ULL;
+    hash = hash_bytes(hash, rgb_output->colors, rgb_output->count * sizeof(uint32_t));
+    hash = hash_bytes(hash, "|", 1);
+    hash = hash_bytes(hash, frame_output->colors, frame_output->count * sizeof(uint32_t));
+    hash = hash_bytes(hash, &duration, sizeof(duration));
+    hash = hash_bytes(hash, &driver_effect, sizeof(driver_effect));
+    if (cycles != -1)
+        hash = hash_bytes(hash, &cycles, sizeof(cycles)); // Only keyframes change it: other hashes stay as in golden files
+
+    long now = now_ms();
+    if (!first_run && !light->updated && hash == light->written_hash && now - light->written_ms < WRITE_REFRESH_MS)
+    {
+        if (rgb_output->count > 0)
+            metrics.skipped_writes[ATTR_RGB_HEX]++;
+        if (frame_output->count > 0)
+            metrics.skipped_writes[ATTR_FRAME_HEX]++;
+        metrics.skipped_writes[ATTR_CYCLES]++;
+        metrics.skipped_writes[ATTR_DURATION]++;
+        metrics.skipped_writes[ATTR_EFFECT]++;
+        return;
+    }
+    light->written_hash = hash;
+    light->written_ms = now;
+    light->written_effect = driver_effect;
+
+    send_led_output(rgb_output, light);
+    send_led_output(frame_output, light);
+    write_light_attr(dir, "effect_cycles", light->name, "%d\n", cycles);
+    write_light_attr(dir, "effect_duration", light->name, "%d\n", duration);
+    write_light_attr(dir, "effect", light->name, "%d\n", driver_effect);
+}
+
+void update_light_settings(LightSettings *light, const char *dir)
+{
+    char filepath[256];
+    char filepath2[256];
+
+    long render_started_us = monotonic_us();
+
+    if (light->effect != light->shown_effect || light->color != light->shown_color || light->color2 != light->shown_color2)
+    {
+        start_transition(light);
+        light->shown_effect = light->effect;
+        light->shown_color = light->color;
+        light->shown_color2 = light->color2;
+    }
+    expire_layers(light);
+    fade_transition(light);
+    bool composited = layers_visible(light);
+
+    uint32_t lowered_color;
+    light->lowered_effect = composited ? 0 : lower_effect(light, &lowered_color, &light->lowered_duration);
+
+    bool keyframed = keyframes && !composited && light->lowered_effect == 0 && keyframe_segments(light->effect) > 0;
+    bool cyclic = light->lowered_effect == 0 && !keyframed && cycle_table_effect(light->effect);
+    if (!cyclic)
+        cycle_table_reset(&light->cycle);
+    bool play = cyclic && cycle_table_ready(light);
+
+    float step = mapSpeedToProgress(light->duration);
+    light->keyframe_ms = 0;
+    light->next_update_ms = 0;
+    if (keyframed)
+    {
+        light->keyframe_ms = advance_to_keyframe(light, step) * FRAME_MS;
+        light->next_update_ms = frame_ms + light->keyframe_ms;
+    }
+    else
+    {
+        light->progress += step;
+
+        if (light->progress > 1.0f)
+            light->progress = 0.0f;
+    }
+
+    // Update effect and other settings
+    snprintf(filepath, sizeof(filepath), "%s/effect_rgb_hex_%s", dir, light->name);
+    snprintf(filepath2, sizeof(filepath2), "%s/frame_hex", dir, light->name);
+
+    chmodfile(filepath, 1);
+    chmodfile(filepath2, 1);
+    LedOutput rgb_output;
+    LedOutput frame_output;
+    open_led_output(&rgb_output, filepath, false);
+    open_led_output(&frame_output, filepath2, true);
+    if (play)
+    {
+        // Steady state of a periodic effect: the frame is already rendered
+        cycle_table_play(light, &rgb_output, &frame_output);
+        histogram_record(&metrics.render[light->effect], monotonic_us() - render_started_us);
+        if (composited)
+            composite_light(light, &rgb_output, &frame_output);
+        send_light_update(light, dir, &rgb_output, &frame_output);
+        return;
+    }
+
+    SDL_Color tempcolor = HexIntToColor(light->color);
+    int r, g, b;
+    if (light->lowered_effect > 0) // Animated by the driver
+    {
+        put_led_color(&rgb_output, lowered_color);
+    }
+    else if (light->effect == 8) // Color drift
+    {
+        ColorWave(light->progress, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+
+    else if (light->effect == 9) // TwinkleEffect
+    {
+        TwinkleEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+    else if (light->effect == 10) // FireEffect
+    {
+        FireEffect(light->progress, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+    else if (light->effect == 11) // GlitterEffect
+    {
+        GlitterEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+    else if (light->effect == 12) // NeonGlowEffect
+    {
+        NeonGlowEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+    else if (light->effect == 13) // FireEffect
+    {
+        FireflyEffect(light->progress, tempcolor.r, tempcolor.g, tempcolor.b, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+    else if (light->effect == 14) // Aurora
+    {
+        AuroraEffect(light->progress, &r, &g, &b);
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+    else if (light->effect == 15) // Reactive
+    {
+        render_reactive(light, &rgb_output, &frame_output);
+    }
+
+    else if (light->effect == 16) // Battery Level
+    {
+        BatteryLevelToColor(light, &r, &g, &b);
+
+        // int LED_COUNT = 23;
+        // for (int j = 0; j < LED_COUNT; j++)
+        // {
+        //     light->colorarray[j] = (r << 16) | (g << 8) | b;
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        // }
+
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+
+    else if (light->effect == 17) // CPU Speed
+    {
+        CpuSpeedToColor(light, &r, &g, &b);
+
+        // int LED_COUNT = 23;
+        // for (int j = 0; j < LED_COUNT; j++)
+        // {
+        //     light->colorarray[j] = (r << 16) | (g << 8) | b;
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        // }
+
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+
+    else if (light->effect == 18) // CPU Temperature
+    {
+        CpuTempToColor(light, &r, &g, &b);
+
+        // int LED_COUNT = 23;
+        // for (int j = 0; j < LED_COUNT; j++)
+        // {
+        //     light->colorarray[j] = (r << 16) | (g << 8) | b;
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        // }
+
+        put_led_color(&rgb_output, rgb_color(r, g, b));
+    }
+
+    else if (light->effect == 19) // Ambilight
+    {
+        update_ambilight(light);
+
+        // No need to write to file/file_frame_hex
+        chmodfile(filepath, 0);
+        chmodfile(filepath2, 0);
+        return;
+    }
+
+    else if (light->effect == 20) // Nothing
+    {
+        // Do nothing: leave it to another external process, unless layers are shown over it
+        if (!composited)
+        {
+            // chmodfile(filepath, 0);
+            // chmodfile(filepath2, 0);
+            return;
+        }
+    }
+    else if (light->effect == 21) // Rainbow Snake
+    {
+        put_led_color(&frame_output, 0);
+        ColorWave(light->progress, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.1, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.2, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.3, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.4, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        //////////// mirror rotation / symetry  //////////
+        ColorWave(light->progress + 0.3, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.2, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.1, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        ColorWave(light->progress + 0.4, &r, &g, &b);
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+        put_led_color(&frame_output, rgb_color(r, g, b));
+
+        //////////// same rotation //////////
+        //  ColorWave(light->progress, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.1, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.2, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.3, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.4, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        /////////// inverted position ///////////
+
+        //     ColorWave(light->progress + 0.4, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.3, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.2, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress + 0.1, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+
+        //     ColorWave(light->progress, &r, &g, &b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+        //     fprintf(file_frame_hex, "%02X%02X%02X ", r, g, b);
+    }
+    else if (light->effect == 22) // Rotation
+    {
+        int LED_COUNT = 23;
+        // static int current_i = 1; // Starts at 1, because 0 is reserved
+
+        int current_i = ((int)(light->progress * 11.0f)) % 11 + 1; // use speed instead of standard increment
+
+        // Every leds to black
+        for (int j = 0; j < LED_COUNT; j++)
+        {
+            light->colorarray[j] = 0x000000;
+        }
+
+        // Never touch colorarray[0].
+        if (current_i < 12)
+        {
+            light->colorarray[current_i] = light->color;      // left stick (1 to 11)
+            light->colorarray[current_i + 11] = light->color; // right stick (12 to 22)
+        }
+
+        // Display
+        for (int j = 0; j < LED_COUNT; j++)
+        {
+            put_led_color(&frame_output, light->colorarray[j]);
+        }
+    }
+    else if (light->effect == 23) // Rotation Mirror
+    {
+
+        int LED_COUNT = 23;
+        // static int current_i = 1; // Starts at 1, because 0 is reserved
+        int current_i = ((int)(light->progress * 11.0f)) % 11 + 1; // use speed instead of standard increment
+
+        // Required offset between the two rotating LEDs
+        int offset = 7; // 1 -> opposite
+
+        // Resets everything to black
+        for (int j = 0; j < LED_COUNT; j++)
+        {
+            light->colorarray[j] = 0x000000;
+        }
+
+        // Index calculation for opposite LED with offset
+        int opposite_i = 23 - current_i + offset;
+
+        // Clamp to stay within valid limits [12..22]
+        if (opposite_i >= LED_COUNT)
+            opposite_i -= 11; // loops back to [12..22].
+        if (opposite_i < 12)
+            opposite_i += 11;
+
+        // Apply colors
+        if (current_i < 12)
+        {
+            light->colorarray[current_i] = light->color;
+            light->colorarray[opposite_i] = light->color;
+        }
+
+        // Display
+        for (int j = 0; j < LED_COUNT; j++)
+        {
+            put_led_color(&frame_output, light->colorarray[j]);
+        }
+    }
+
+    else if (light->effect == 24) // Directions
+    {
+
+        int LED_COUNT = 23;
+        for (int j = 0; j < LED_COUNT; j++)
+            light->colorarray[j] = 0x000000;
+
+        if (dpad_y < 0) // Up
+        {
+            light->colorarray[9] = light->color;
+            // light->colorarray[10] = light->color;
+            light->colorarray[11] = light->color;
+
+            light->colorarray[20] = light->color;
+            light->colorarray[22] = light->color;
+        }
+        else if (dpad_y > 0) // Down
+        {
+            light->colorarray[4] = light->color;
+            light->colorarray[5] = light->color;
+
+            light->colorarray[15] = light->color;
+            light->colorarray[16] = light->color;
+        }
+
+        if (dpad_x < 0) // Left
+        {
+            light->colorarray[1] = light->color;
+            // light->colorarray[2] = light->color;
+            light->colorarray[3] = light->color;
+
+            light->colorarray[12] = light->color;
+            light->colorarray[14] = light->color;
+        }
+        else if (dpad_x > 0) // Right
+        {
+            light->colorarray[6] = light->color;
+            // light->colorarray[13] = light->color;
+            light->colorarray[8] = light->color;
+
+            light->colorarray[17] = light->color;
+            light->colorarray[19] = light->color;
+        }
+
+        for (int j = 0; j < LED_COUNT; j++)
+        {
+            put_led_color(&frame_output, light->colorarray[j]);
+        }
+    }
+
+    else if (light->effect == 25) // Stick Tracker
+    {
+        render_stick_tracker(light, &frame_output);
+    }
+
+    else if (light->effect == 26) // Audio Spectrum
+    {
+        render_audio_spectrum(light, &frame_output);
+    }
+
+    else
+    {
+        // Native effect, animated here when the light is composited without driver effect
+        put_led_color(&rgb_output, composited ? native_effect_color(light) : light->color);
+    }
+
+    chmodfile(filepath, 0);
+    chmodfile(filepath2, 0);
+
+    if (cyclic)
+        cycle_table_record(light, &rgb_output, &frame_output);
+
+    histogram_record(&metrics.render[light->effect >= 0 && light->effect <= METRICS_MAX_EFFECT ? light->effect : 0], monotonic_us() - render_started_us);
+    if (composited)
+        composite_light(light, &rgb_output, &frame_output);
+    send_light_update(light, dir, &rgb_output, &frame_output);
+}
+
+// Control socket: one text command per datagram, answered to the sender when it is bound (see lcctl.h)
+int open_control_socket()
+{
+    int fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        perror("Control socket");
+        return -1;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", PATH(PATH_SOCKET)) >= (int)sizeof(addr.sun_path))
+    {
+        fprintf(stderr, "Control socket path too long: %s\n", PATH(PATH_SOCKET));
+        close(fd);
+        return -1;
+    }
+    unlink(addr.sun_path);
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0)
+    {
+        perror("Control socket bind");
+        close(fd);
+        return -1;
+    }
+    chmod(addr.sun_path, 0666); // Scripts and apps do not run as root
+    return fd;
+}
+
+LightSettings *find_light(const char *name)
+{
+    for (int i = 0; i < num_lights; i++)
+    {
+        if (strcmp(lights[i].name, name) == 0)
+            return &lights[i];
+    }
+    return NULL;
+}
+
+int describe_light(const LightSettings *light, char *reply, int size)
+{
+    return snprintf(reply, size, " %s: effect=%d color=0x%06X color2=0x%06X duration=%d brightness=%d trigger=%d triggers=0x%X",
+                    light->name, light->effect, light->color, light->color2, light->duration, light->brightness, light->trigger,
+                    reactive_triggers(light));
+}
+
+void handle_control_command(char *command, char *reply, int size)
+{
+    char *words[4] = {0};
+    int count = 0;
+    for (char *word = strtok(command, " \t\r\n"); word != NULL && count < 4; word = strtok(NULL, " \t\r\n"))
+        words[count++] = word;
+
+    if (count == 0)
+    {
+        snprintf(reply, size, "error: empty command");
+        return;
+    }
+
+    if (strcmp(words[0], "stats") == 0)
+    {
+        snprintf(reply, size, "ok uptime_ms=%ld ticks=%lu wakeups=%lu commands=%lu lights=%d",
+                 now_ms() - stats_started_ms, stats_ticks, stats_wakeups, stats_commands, num_lights);
+        return;
+    }
+
+    if (strcmp(words[0], "get") == 0)
+    {
+        int len = snprintf(reply, size, "ok");
+        for (int i = 0; i < num_lights && len < size; i++)
+        {
+            if (count < 2 || strcmp(words[1], lights[i].name) == 0)
+                len += describe_light(&lights[i], reply + len, size - len);
+        }
+        return;
+    }
+
+    LightSettings *light = count >= 2 ? find_light(words[1]) : NULL;
+    if (light == NULL)
+    {
+        snprintf(reply, size, "error: unknown light %s", count >= 2 ? words[1] : "");
+        return;
+    }
+
+    if (strcmp(words[0], "set") == 0 && count == 4)
+    {
+        if (strcmp(words[2], "effect") != 0 && strcmp(words[2], "color") != 0 && strcmp(words[2], "color2") != 0 &&
+            strcmp(words[2], "duration") != 0 && strcmp(words[2], "brightness") != 0 && strcmp(words[2], "trigger") != 0 &&
+            strcmp(words[2], "triggers") != 0)
+        {
+            snprintf(reply, size, "error: unknown setting %s", words[2]);
+            return;
+        }
+        set_light_value(light, words[2], words[3]);
+        snprintf(reply, size, "ok");
+    }
+    else if (strcmp(words[0], "flash") == 0 && count >= 3)
+    {
+        int duration = count == 4 ? atoi(words[3]) : LCCTL_FLASH_DEFAULT_MS;
+        uint32_t color = strtoul(words[2], NULL, 16) & 0xFFFFFF;
+        fill_layer(light, LAYER_FLASH, BLEND_NORMAL, 0xFF000000 | color, now_ms() + (duration > 0 ? duration : LCCTL_FLASH_DEFAULT_MS));
+        light->updated = true;
+        snprintf(reply, size, "ok");
+    }
+    else
+    {
+        snprintf(reply, size, "error: usage: set <light> <key> <value> | flash <light> <RRGGBB> [ms] | get [light] | stats");
+    }
+}
+
+void handle_control_socket(int fd)
+{
+    char command[LCCTL_MAX_MESSAGE + 1];
+    char reply[LCCTL_MAX_MESSAGE];
+    struct sockaddr_un sender;
+    socklen_t sender_len = sizeof(sender);
+    int len;
+
+    while ((len = recvfrom(fd, command, sizeof(command) - 1, 0, (struct sockaddr *)&sender, &sender_len)) >= 0)
+    {
+        command[len] = '\0';
+        stats_commands++;
+        handle_control_command(command, reply, sizeof(reply));
+
+        if (sender_len > sizeof(sa_family_t))
+            sendto(fd, reply, strlen(reply), MSG_DONTWAIT, (struct sockaddr *)&sender, sender_len);
+        sender_len = sizeof(sender);
+    }
+}
+
+// Shows the newest frame published by an external app as the top layer of the lights, until it gets too old.
+// Priority frames are shown over every effect, others only over the lights set to "Nothing".
+void forward_external_frame()
+{
+    if (frame_ring == NULL)
+        return;
+
+    uint32_t head;
+    const SharedFrame *frame = ledshm_frames_latest(frame_ring, &head);
+    if (frame == NULL)
+        return;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    long age_ms = ((int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec - (int64_t)frame->timestamp_ns) / 1000000;
+    long hold_ms = frame->hold_ms ? frame->hold_ms : LEDSHM_FRAME_HOLD_MS;
+    if (age_ms < hold_ms)
+    {
+        uint32_t argb[LEDSHM_LED_COUNT];
+        for (int i = 0; i < LEDSHM_LED_COUNT; i++)
+            argb[i] = 0xFF000000 | (frame->colors[i] & 0xFFFFFF);
+        for (int i = 0; i < num_lights; i++)
+        {
+            if (frame->priority > 0 || lights[i].effect == 20)
+                set_layer(&lights[i], LAYER_EXTERNAL, BLEND_NORMAL, argb, now_ms() + hold_ms - age_ms);
+        }
+    }
+    ledshm_frames_release(frame_ring, head);
+}
+
+bool checkIfEffectChanged(LightSettings *light)
+{
+    int native_effect = light->effect < 8 ? light->effect : light->lowered_effect;
+    if (native_effect > 0)
+    {
+        char filepath[256];
+        FILE *file;
+        snprintf(filepath, sizeof(filepath), "%s/effect_%s", PATH(PATH_LED_ANIM), light->name);
+        file = fopen(filepath, "r");
+        if (file != NULL)
+        {
+            char current_value[20];
+            if (fgets(current_value, sizeof(current_value), file))
+            {
+                int current_effect;
+                sscanf(current_value, "%d", &current_effect);
+                fclose(file);
+                return current_effect != light->written_effect; // Changed by another process since it was written
+            }
+        }
+    }
+    else
+    {
+        if (light->effect != light->last_effect)
+        {
+            light->last_effect = light->effect;
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+}
+
+void handle_js_event(const struct js_event *event)
+{
+    if (event->type == JS_EVENT_BUTTON && event->number < 16) // Bits below TRIGGER_DPAD
+    {
+        if (event->value)
+        {
+            held_buttons |= 1u << event->number;
+            latched_buttons |= 1u << event->number;
+        }
+        else
+        {
+            held_buttons &= ~(1u << event->number);
+        }
+    }
+    else if (event->type == JS_EVENT_AXIS)
+    {
+        if (event->number < 4) // Sticks: only the latest vector is rendered, see stick tracker
+        {
+            stick_axes[event->number] = event->value;
+            sticks_moved = true;
+        }
+        // Hat0X (left/right)
+        if (event->number == 6)
+        {
+            dpad_x = event->value;
+        }
+        // Hat0Y (up/down)
+        else if (event->number == 7)
+        {
+            dpad_y = event->value;
+        }
+
+        if (event->number == 6 || event->number == 7)
+        {
+            uint32_t leds = dpad_region(dpad_x, dpad_y);
+            if (leds != 0)
+            {
+                held_buttons |= TRIGGER_DPAD;
+                latched_buttons |= TRIGGER_DPAD;
+                latched_dpad_leds |= leds;
+            }
+            else
+            {
+                held_buttons &= ~TRIGGER_DPAD;
+            }
+        }
+    }
+}
+
+// =========== Replay ===========
+
+TraceRecord replay_record; // Next record, applied once the clock reaches it
+uint8_t replay_payload[256];
+bool replay_pending = false;
+unsigned long replay_count = 0;
+
+void replay_read_next()
+{
+    replay_pending = fread(&replay_record, sizeof(replay_record), 1, replay_file) == 1 &&
+                     fread(replay_payload, 1, replay_record.size, replay_file) == replay_record.size;
+}
+
+long replay_due_ms()
+{
+    return trace_start_ms + replay_record.time_ms;
+}
+
+int start_replay(const char *path)
+{
+    replay_file = fopen(path, "rb");
+    if (replay_file == NULL)
+    {
+        perror(path);
+        return -1;
+    }
+    TraceHeader header;
+    if (fread(&header, sizeof(header), 1, replay_file) != 1 || memcmp(header.magic, TRACE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.version != TRACE_VERSION)
+    {
+        fprintf(stderr, "%s: not a lcdaemon trace\n", path);
+        return -1;
+    }
+    srand(header.seed);
+    battery_alert_percent = header.battery_alert_percent;
+    transition_ms = header.transition_ms;
+    keyframes = header.keyframes;
+    if (replay_fast)
+    {
+        virtual_clock = true;
+        virtual_now_us = monotonic_us();
+    }
+    replay_read_next();
+    return 0;
+}
+
+void replay_apply()
+{
+    if (replay_record.type == TRACE_JS_EVENT && replay_record.size == sizeof(struct js_event))
+    {
+        handle_js_event((const struct js_event *)replay_payload);
+        metrics_input(now_us());
+    }
+    else if (replay_record.type == TRACE_SENSOR && replay_record.size == sizeof(TraceSensor))
+    {
+        const TraceSensor *sensor = (const TraceSensor *)replay_payload;
+        if (sensor->sensor < NUM_SENSORS)
+        {
+            sensors[sensor->sensor] = *sensor;
+            sensor_known[sensor->sensor] = true;
+        }
+    }
+    else if (replay_record.type == TRACE_LIGHT && replay_record.size == sizeof(TraceLight))
+    {
+        const TraceLight *traced = (const TraceLight *)replay_payload;
+        char name[LEDSHM_NAME_LEN + 1];
+        memcpy(name, traced->name, LEDSHM_NAME_LEN);
+        name[LEDSHM_NAME_LEN] = '\0';
+
+        LightSettings *light = get_light(name);
+        if (light != NULL)
+        {
+            light->effect = traced->effect;
+            light->color = traced->color;
+            light->color2 = traced->color2;
+            light->duration = traced->duration;
+            light->brightness = traced->brightness;
+            light->trigger = traced->trigger;
+            light->triggers = traced->triggers;
+            if (traced->flash_ms > 0)
+                fill_layer(light, LAYER_FLASH, BLEND_NORMAL, 0xFF000000 | traced->flash_color, now_ms() + traced->flash_ms);
+            else
+                light->layer_mask &= ~(1u << LAYER_FLASH);
+            light->updated = true;
+        }
+    }
+    else if (replay_record.type == TRACE_RESYNC)
+    {
+        first_run = true;
+    }
+    replay_count++;
+}
+
+#ifndef LCDAEMON_NO_MAIN // lcbench.c includes this file for the effect code
+
+int main(int argc, char *argv[])
+{
+    if (configure_paths(argc, argv) != 0)
+    {
+        return 1;
+    }
+
+    const char *record_path = NULL;
+    const char *replay_path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            record_path = argv[++i];
+        else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc)
+            replay_path = argv[++i];
+        else if (strcmp(argv[i], "--fast") == 0)
+            replay_fast = true;
+        else if (strcmp(argv[i], "--keyframes") == 0)
+            keyframes = true;
+        else if (strcmp(argv[i], "--battery-alert") == 0 && i + 1 < argc)
+            battery_alert_percent = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--transition") == 0 && i + 1 < argc)
+            transition_ms = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--audio-device") == 0 && i + 1 < argc)
+            audio_device = argv[++i];
+        else if (strcmp(argv[i], "--audio-wav") == 0 && i + 1 < argc)
+            audio_wav_path = argv[++i];
+    }
+    if ((record_path != NULL && start_recording(record_path) != 0) || (replay_path != NULL && start_replay(replay_path) != 0))
+    {
+        return 1;
+    }
+    bool live_inputs = replay_file == NULL; // A replay gets all of its inputs from the trace
+    long started_us = monotonic_us();
+
+    int fd = live_inputs ? open(PATH(PATH_JOYSTICK), O_RDONLY | O_NONBLOCK) : -1;
+    if (fd < 0)
+    {
+        if (live_inputs)
+            perror("Failed joystick device");
+    }
+    else
+    {
+        jsopen = 1;
+    }
+
+    signal(SIGTERM, handle_sigterm);
+    signal(SIGCONT, handle_sigcont);
+    signal(SIGHUP, handle_sighup);
+    signal(SIGUSR1, handle_sigusr1);
+    signal(SIGSTOP, handle_sigsleep);
+
+    changePermissions(PATH(PATH_LED_ANIM), 1);
+
+    int inotify_fd = live_inputs ? watch_settings() : -1;
+    struct timespec reload_time;
+    bool reload_pending = false;
+
+    if (live_inputs && read_settings("led_daemon.conf") != 0)
+    {
+        return 1;
+    }
+
+    int control_fd = live_inputs ? open_control_socket() : -1;
+    frame_ring = ledshm_frames_open(1);
+    if (frame_ring == NULL)
+    {
+        perror("Unable to create the frame ring");
+    }
+    preview = ledshm_preview_open(1);
+    if (preview == NULL)
+    {
+        perror("Unable to create the preview buffer");
+    }
+    stats_started_ms = now_ms();
+    trace_start_ms = stats_started_ms; // Recorded times are relative to the first frame, so the replay keeps its phase
+    long next_tick = stats_started_ms;
+
+    while (running)
+    {
+        // Sleep until the next frame, or until input, a config change or a command arrives
+        struct pollfd fds[3] = {
+            {.fd = jsopen ? fd : -1, .events = POLLIN},
+            {.fd = inotify_fd, .events = POLLIN},
+            {.fd = control_fd, .events = POLLIN},
+        };
+        long wake_ms = replay_pending && replay_due_ms() < next_tick ? replay_due_ms() : next_tick;
+        bool sticks_shown = false;
+        bool audio_shown = false;
+        for (int i = 0; i < num_lights; i++)
+        {
+            if (lights[i].effect == 25)
+                sticks_shown = true;
+            if (lights[i].effect == 26)
+                audio_shown = true;
+        }
+        if (sticks_shown && sticks_moved && sticks_rendered_ms + STICK_FRAME_MS < wake_ms)
+            wake_ms = sticks_rendered_ms + STICK_FRAME_MS;
+        if (audio_shown && audio_rendered_ms + AUDIO_FRAME_MS < wake_ms)
+            wake_ms = audio_rendered_ms + AUDIO_FRAME_MS;
+        long timeout = wake_ms - now_ms();
+        if (virtual_clock)
+        {
+            // Fast replay: nothing to wait for, jump straight to the next frame or event
+            if (timeout > 0)
+                virtual_now_us = wake_ms * 1000;
+        }
+        else if (poll(fds, 3, timeout > 0 ? timeout : 0) < 0)
+        {
+            fds[0].revents = fds[1].revents = fds[2].revents = 0; // interrupted by a signal
+        }
+        stats_wakeups++;
+        long woke_us = now_us();
+        bool tick = woke_us / 1000 >= next_tick;
+        frame_ms = tick ? next_tick : woke_us / 1000;
+        if (tick)
+        {
+            histogram_record(&metrics.tick_jitter, woke_us - next_tick * 1000);
+        }
+
+        if (live_inputs && !jsopen && tick)
+        {
+            // Attempt to open the device if it is not already opened
+            fd = open(PATH(PATH_JOYSTICK), O_RDONLY | O_NONBLOCK);
+            if (fd < 0)
+            {
+                perror("Failed joystick device");
+            }
+            else
+            {
+                printf("Joystick device opened successfully.\n");
+                jsopen = 1; // Set the flag to indicate the device is opened
+            }
+        }
+
+        struct js_event event;
+        while (fds[0].revents & POLLIN && read(fd, &event, sizeof(event)) > 0)
+        {
+            metrics_input(woke_us);
+            trace_write(TRACE_JS_EVENT, &event, sizeof(event));
+            handle_js_event(&event);
+        }
+        if (fds[0].revents & (POLLERR | POLLHUP))
+        {
+            close(fd); // Joystick went away, reopened on a later tick
+            jsopen = 0;
+        }
+
+        while (replay_pending && now_ms() >= replay_due_ms())
+        {
+            replay_apply();
+            replay_read_next();
+        }
+
+        if (reload_requested)
+        {
+            // The UI is starting: re-read everything and rewrite every light on the next frame
+            reload_requested = 0;
+            clock_gettime(CLOCK_MONOTONIC, &reload_time);
+            if (live_inputs && read_settings("led_daemon.conf") == 0)
+            {
+                reload_pending = true;
+                shared_settings_seq = 0;
+            }
+            first_run = true;
+        }
+
+        if (fds[1].revents & POLLIN && settings_file_changed(inotify_fd, "led_daemon.conf"))
+        {
+            clock_gettime(CLOCK_MONOTONIC, &reload_time);
+            if (read_settings("led_daemon.conf") == 0)
+            {
+                reload_pending = true;
+                // While the UI runs its shared settings are authoritative: re-apply them over what was just saved
+                shared_settings_seq = 0;
+            }
+        }
+
+        if (tick && live_inputs && access(PATH(PATH_LIVE_FLAG), F_OK) == 0)
+        {
+            // The UI publishes every change in shared memory: without inotify, fall back to polling the SD card until it is up
+            if (!read_shared_settings() && inotify_fd < 0 && read_settings("led_daemon.conf") != 0)
+            {
+                return 1;
+            }
+        }
+
+        if (fds[2].revents & POLLIN)
+        {
+            handle_control_socket(control_fd);
+        }
+
+        if (tick && live_inputs)
+        {
+            forward_external_frame();
+        }
+        if (tick)
+        {
+            update_battery_alert();
+            update_reactive_layers();
+        }
+
+        if (first_run)
+        {
+            trace_write(TRACE_RESYNC, NULL, 0);
+        }
+
+        // Stick motion is shown between frames too, coalesced
+        bool stick_frame = sticks_shown && sticks_moved && (tick || now_ms() - sticks_rendered_ms >= STICK_FRAME_MS);
+        if (stick_frame)
+        {
+            sticks_moved = false;
+            sticks_rendered_ms = now_ms();
+        }
+        bool audio_frame = audio_shown && (tick || now_ms() - audio_rendered_ms >= AUDIO_FRAME_MS);
+        if (audio_frame)
+            audio_rendered_ms = now_ms();
+
+        bool committed = false;
+        for (int i = 0; i < num_lights; i++)
+        {
+            // Check current effect before updating
+            if (tick && checkIfEffectChanged(&lights[i]))
+            {
+                lights[i].updated = true;
+            }
+            if (lights[i].updated)
+            {
+                metrics_input(woke_us);
+                trace_light(&lights[i]);
+            }
+
+            // Changes are applied as soon as they arrive, animations advance once per frame
+            if (lights[i].updated || first_run || (tick && ((lights[i].effect >= 8 && lights[i].lowered_effect == 0 && frame_ms >= lights[i].next_update_ms) || lights[i].layer_mask != 0)) ||
+                (stick_frame && lights[i].effect == 25) || (audio_frame && lights[i].effect == 26))
+            {
+                changebrightness(PATH(PATH_LED_ANIM), lights[0].brightness);
+                if (lights[i].updated)
+                    committed = true;
+                update_light_settings(&lights[i], PATH(PATH_LED_ANIM));
+                lights[i].updated = false;
+            }
+        }
+
+        flush_output_frame(PATH(PATH_LED_ANIM));
+        publish_committed_frame();
+
+        if (metrics.pending_input_us != 0 && (committed || tick))
+        {
+            histogram_record(&metrics.input_to_commit, now_us() - metrics.pending_input_us);
+            metrics.pending_input_us = 0;
+        }
+
+        if (reload_pending && committed)
+        {
+            printf("Config reload reached the LEDs in %ld us\n", elapsed_us(&reload_time));
+            reload_pending = false;
+        }
+        else if (reload_pending)
+        {
+            reload_pending = false; // nothing changed
+        }
+
+        if (tick)
+        {
+            first_run = false; // Set to false after the first frame
+            latched_buttons = 0;
+            latched_dpad_leds = 0;
+            stats_ticks++;
+            next_tick += FRAME_MS;
+            if (next_tick <= now_ms())
+            {
+                metrics.deadline_misses += (now_ms() - next_tick) / FRAME_MS + 1;
+                next_tick = now_ms() + FRAME_MS; // Do not try to catch up on missed frames
+            }
+        }
+
+        if (metrics_requested)
+        {
+            metrics_requested = 0;
+            metrics_dump(stdout);
+            fflush(stdout);
+            metrics_write_file();
+        }
+        else if (tick && now_ms() - metrics.file_written_ms >= METRICS_FILE_MS)
+        {
+            metrics_write_file();
+        }
+
+        if (tick && trace_dirty)
+        {
+            fflush(trace_file);
+            trace_dirty = false;
+        }
+        if (replay_file != NULL && !replay_pending)
+        {
+            running = 0; // End of the trace
+        }
+    }
+    close(fd);
+    if (control_fd >= 0)
+    {
+        close(control_fd);
+        unlink(PATH(PATH_SOCKET));
+    }
+    if (inotify_fd >= 0)
+        close(inotify_fd);
+    ledshm_settings_close(shared_settings);
+    ledshm_frames_close(frame_ring);
+    ledshm_preview_close(preview);
+    if (trace_file != NULL)
+    {
+        frame_ms = now_ms();
+        trace_write(TRACE_END, NULL, 0);
+        fclose(trace_file);
+    }
+    if (replay_file != NULL)
+    {
+        fclose(replay_file);
+        printf("Replayed %lu records, %lu frames in %ld ms\n", replay_count, stats_ticks, (monotonic_us() - started_us) / 1000);
+        metrics_dump(stdout);
+    }
+    free(lights);
+    printf("Received SIGTERM, exiting color app...\n");
+
+    return 0;
+}
+
+#endif
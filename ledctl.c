@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "lcctl.h"
+
+// Tiny client for the lcdaemon control socket, e.g.:
+//   ledctl set lr effect 21
+//   ledctl flash m FF0000 300
+//   ledctl get lr
+//   ledctl stats
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s set <light> <key> <value> | flash <light> <RRGGBB> [ms] | get [light] | stats\n", argv[0]);
+        return 1;
+    }
+
+    char message[LCCTL_MAX_MESSAGE];
+    int len = 0;
+    for (int i = 1; i < argc && len < (int)sizeof(message); i++)
+    {
+        len += snprintf(message + len, sizeof(message) - len, i > 1 ? " %s" : "%s", argv[i]);
+    }
+    if (len >= (int)sizeof(message))
+    {
+        fprintf(stderr, "Command too long\n");
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0)
+    {
+        perror("socket");
+        return 1;
+    }
+
+    // Bind to our own address so that the daemon can answer
+    struct sockaddr_un local = {.sun_family = AF_UNIX};
+    snprintf(local.sun_path, sizeof(local.sun_path), "/tmp/ledctl.%d.sock", getpid());
+    unlink(local.sun_path);
+    if (bind(fd, (struct sockaddr *)&local, sizeof(local)) != 0)
+    {
+        perror("bind");
+        close(fd);
+        return 1;
+    }
+
+    // Same lookup as lcdaemon: LCDAEMON_SOCKET, else the default path under LCDAEMON_ROOT
+    struct sockaddr_un daemon = {.sun_family = AF_UNIX};
+    const char *root = getenv("LCDAEMON_ROOT");
+    if (getenv("LCDAEMON_SOCKET") != NULL)
+        snprintf(daemon.sun_path, sizeof(daemon.sun_path), "%s", getenv("LCDAEMON_SOCKET"));
+    else
+        snprintf(daemon.sun_path, sizeof(daemon.sun_path), "%s%s", root ? root : "", LCCTL_SOCKET_PATH);
+
+    int ret = 1;
+    if (sendto(fd, message, len, 0, (struct sockaddr *)&daemon, sizeof(daemon)) < 0)
+    {
+        perror("Unable to reach lcdaemon");
+    }
+    else
+    {
+        struct pollfd pfd = {.fd = fd, .events = POLLIN};
+        if (poll(&pfd, 1, 1000) > 0)
+        {
+            char reply[LCCTL_MAX_MESSAGE + 1];
+            int reply_len = recv(fd, reply, sizeof(reply) - 1, 0);
+            if (reply_len >= 0)
+            {
+                reply[reply_len] = '\0';
+                printf("%s\n", reply);
+                ret = strncmp(reply, "ok", 2) == 0 ? 0 : 1;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "No answer from lcdaemon\n");
+        }
+    }
+
+    close(fd);
+    unlink(local.sun_path);
+    return ret;
+}
@@ -0,0 +1,354 @@
+#ifndef LEDSHM_H
+#define LEDSHM_H
+
+// Shared memory segments of the LED daemon (lcdaemon): settings published by the LED Control UI (main)
+// and frames published by other apps. Everything lives in /dev/shm so that nothing in here ever touches the SD card.
+
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LEDSHM_SETTINGS_NAME "/led_daemon_settings" // -> /dev/shm/led_daemon_settings
+#define LEDSHM_SETTINGS_MAGIC 0x4C454453            // "LEDS"
+#define LEDSHM_SETTINGS_VERSION 2
+#define LEDSHM_MAX_LIGHTS 8
+#define LEDSHM_NAME_LEN 16
+#define LEDSHM_TRIGGERS_LEN 64
+
+typedef struct
+{
+    char name[LEDSHM_NAME_LEN];
+    int32_t effect;
+    int32_t duration;
+    int32_t brightness;
+    int32_t trigger;
+    uint32_t color;
+    uint32_t color2;
+    char triggers[LEDSHM_TRIGGERS_LEN]; // triggers= of led_daemon.conf as written, empty when not set
+} SharedLightSettings;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq; // seqlock: odd while the UI is writing
+    uint32_t num_lights;
+    SharedLightSettings lights[LEDSHM_MAX_LIGHTS];
+} SharedSettings;
+
+// Maps the settings segment. The UI creates it (create = 1), the daemon only attaches to it.
+// The segment is never unlinked so that a daemon which attached once keeps seeing every later UI session.
+static inline SharedSettings *ledshm_settings_open(int create)
+{
+    int fd = shm_open(LEDSHM_SETTINGS_NAME, create ? O_RDWR | O_CREAT : O_RDONLY, 0644);
+    if (fd < 0)
+        return NULL;
+
+    if (create && ftruncate(fd, sizeof(SharedSettings)) != 0)
+    {
+        close(fd);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SharedSettings))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    SharedSettings *shm = mmap(NULL, sizeof(SharedSettings), create ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (shm == MAP_FAILED)
+        return NULL;
+
+    if (create)
+    {
+        shm->magic = LEDSHM_SETTINGS_MAGIC;
+        shm->version = LEDSHM_SETTINGS_VERSION;
+        // A previous writer may have died in the middle of an update
+        if (__atomic_load_n(&shm->seq, __ATOMIC_RELAXED) & 1)
+            __atomic_store_n(&shm->seq, shm->seq + 1, __ATOMIC_RELEASE);
+    }
+    return shm;
+}
+
+static inline void ledshm_settings_close(SharedSettings *shm)
+{
+    if (shm != NULL)
+        munmap(shm, sizeof(SharedSettings));
+}
+
+// Single writer (the UI)
+static inline void ledshm_settings_write(SharedSettings *shm, const SharedLightSettings *lights, int count)
+{
+    if (count > LEDSHM_MAX_LIGHTS)
+        count = LEDSHM_MAX_LIGHTS;
+
+    uint32_t seq = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&shm->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    memcpy(shm->lights, lights, count * sizeof(SharedLightSettings));
+    shm->num_lights = count;
+
+    __atomic_store_n(&shm->seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+// Lock-free reader (the daemon). Returns the number of lights copied into out,
+// 0 when nothing changed since *last_seq, or -1 when no consistent snapshot could be taken.
+static inline int ledshm_settings_read(const SharedSettings *shm, SharedLightSettings *out, int max, uint32_t *last_seq)
+{
+    if (shm->magic != LEDSHM_SETTINGS_MAGIC || shm->version != LEDSHM_SETTINGS_VERSION)
+        return -1;
+
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        uint32_t seq1 = __atomic_load_n(&shm->seq, __ATOMIC_ACQUIRE);
+        if (seq1 == *last_seq)
+            return 0;
+        if (seq1 & 1)
+            continue; // writer in progress
+
+        int count = shm->num_lights;
+        if (count > max)
+            count = max;
+        if (count > LEDSHM_MAX_LIGHTS)
+            count = LEDSHM_MAX_LIGHTS;
+        memcpy(out, shm->lights, count * sizeof(SharedLightSettings));
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        uint32_t seq2 = __atomic_load_n(&shm->seq, __ATOMIC_RELAXED);
+        if (seq1 == seq2)
+        {
+            *last_seq = seq1;
+            return count;
+        }
+    }
+    return -1;
+}
+
+// Frame submission ring: external apps (emulator cores, visualizers, scripts) publish full LED frames,
+// lcdaemon stays the only process writing to /sys/class/led_anim.
+// Single producer (the app) / single consumer (the daemon): the producer only writes head,
+// the daemon only writes tail, and a slot is never rewritten before the daemon moved past it.
+
+#define LEDSHM_FRAMES_NAME "/led_daemon_frames" // -> /dev/shm/led_daemon_frames
+#define LEDSHM_FRAMES_MAGIC 0x4C454446          // "LEDF"
+#define LEDSHM_FRAMES_VERSION 1
+#define LEDSHM_FRAME_SLOTS 8
+#define LEDSHM_LED_COUNT 23
+#define LEDSHM_FRAME_HOLD_MS 500 // Default time a frame stays on the LEDs without a newer one
+
+typedef struct
+{
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC
+    uint32_t priority;     // 0: only shown on lights set to "Nothing" (20), > 0: shown over any effect
+    uint32_t hold_ms;      // How long the frame stays valid, 0 for LEDSHM_FRAME_HOLD_MS
+    uint32_t colors[LEDSHM_LED_COUNT]; // 0xRRGGBB, same order as frame_hex
+} SharedFrame;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t head; // Frames published so far, written by the producer
+    uint32_t tail; // Frames consumed so far, written by the daemon
+    SharedFrame slots[LEDSHM_FRAME_SLOTS];
+} SharedFrameRing;
+
+// The daemon creates the ring (create = 1), apps attach to it.
+static inline SharedFrameRing *ledshm_frames_open(int create)
+{
+    int fd = shm_open(LEDSHM_FRAMES_NAME, O_RDWR | (create ? O_CREAT : 0), 0666);
+    if (fd < 0)
+        return NULL;
+
+    if (create && (ftruncate(fd, sizeof(SharedFrameRing)) != 0 || fchmod(fd, 0666) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SharedFrameRing))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    SharedFrameRing *ring = mmap(NULL, sizeof(SharedFrameRing), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ring == MAP_FAILED)
+        return NULL;
+
+    if (create)
+    {
+        ring->magic = LEDSHM_FRAMES_MAGIC;
+        ring->version = LEDSHM_FRAMES_VERSION;
+        // Frames published before the daemon (re)started are stale
+        __atomic_store_n(&ring->tail, __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
+    }
+    else if (ring->magic != LEDSHM_FRAMES_MAGIC || ring->version != LEDSHM_FRAMES_VERSION)
+    {
+        munmap(ring, sizeof(SharedFrameRing));
+        return NULL;
+    }
+    return ring;
+}
+
+static inline void ledshm_frames_close(SharedFrameRing *ring)
+{
+    if (ring != NULL)
+        munmap(ring, sizeof(SharedFrameRing));
+}
+
+// Producer side. Returns -1 when the daemon is LEDSHM_FRAME_SLOTS frames behind: retry with the next frame.
+static inline int ledshm_frames_publish(SharedFrameRing *ring, const uint32_t *colors, uint32_t priority, uint32_t hold_ms)
+{
+    uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LEDSHM_FRAME_SLOTS)
+        return -1;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    SharedFrame *frame = &ring->slots[head % LEDSHM_FRAME_SLOTS];
+    frame->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    frame->priority = priority;
+    frame->hold_ms = hold_ms;
+    memcpy(frame->colors, colors, sizeof(frame->colors));
+
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+// Consumer side: returns the newest unread frame, or NULL. The frame stays valid until ledshm_frames_release().
+static inline const SharedFrame *ledshm_frames_latest(SharedFrameRing *ring, uint32_t *head)
+{
+    *head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+    if (*head == ring->tail)
+        return NULL;
+    return &ring->slots[(*head - 1) % LEDSHM_FRAME_SLOTS];
+}
+
+static inline void ledshm_frames_release(SharedFrameRing *ring, uint32_t head)
+{
+    __atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+}
+
+// Preview triple buffer: lcdaemon publishes every frame it committed to the LEDs, the UI (or any observer)
+// reads the newest one without locks or syscalls. Each side owns one buffer, the third one is exchanged
+// through "middle". Indices live in the segment so that either side can restart.
+
+#define LEDSHM_PREVIEW_NAME "/led_daemon_preview" // -> /dev/shm/led_daemon_preview
+#define LEDSHM_PREVIEW_MAGIC 0x4C454450           // "LEDP"
+#define LEDSHM_PREVIEW_VERSION 1
+#define LEDSHM_PREVIEW_FRESH 0x4 // Set in middle when it holds a frame the reader has not taken yet
+
+typedef struct
+{
+    uint64_t timestamp_ns; // CLOCK_MONOTONIC
+    uint32_t seq;          // Frames committed by the daemon so far
+    uint32_t colors[LEDSHM_LED_COUNT]; // 0xRRGGBB, same order as frame_hex
+} PreviewFrame;
+
+typedef struct
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t seq;    // Frames published so far, written by the daemon only
+    uint32_t back;   // Written by the daemon only
+    uint32_t middle; // Exchanged by both sides
+    uint32_t front;  // Written by the reader only
+    PreviewFrame buffers[3];
+} SharedPreview;
+
+// The daemon creates the segment (create = 1), readers attach to it read-write to swap buffers.
+static inline SharedPreview *ledshm_preview_open(int create)
+{
+    int fd = shm_open(LEDSHM_PREVIEW_NAME, O_RDWR | (create ? O_CREAT : 0), 0666);
+    if (fd < 0)
+        return NULL;
+
+    if (create && (ftruncate(fd, sizeof(SharedPreview)) != 0 || fchmod(fd, 0666) != 0))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(SharedPreview))
+    {
+        close(fd);
+        return NULL;
+    }
+
+    SharedPreview *preview = mmap(NULL, sizeof(SharedPreview), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (preview == MAP_FAILED)
+        return NULL;
+
+    if (create)
+    {
+        // Keep the indices of a previous daemon unless they are not a permutation of 0, 1, 2
+        uint32_t back = preview->back;
+        uint32_t middle = __atomic_load_n(&preview->middle, __ATOMIC_ACQUIRE) & 3;
+        uint32_t front = __atomic_load_n(&preview->front, __ATOMIC_ACQUIRE);
+        if (preview->magic != LEDSHM_PREVIEW_MAGIC || back > 2 || middle > 2 || front > 2 ||
+            back == middle || back == front || middle == front)
+        {
+            memset(preview, 0, sizeof(SharedPreview));
+            preview->back = 0;
+            preview->middle = 1;
+            preview->front = 2;
+        }
+        preview->version = LEDSHM_PREVIEW_VERSION;
+        __atomic_store_n(&preview->magic, LEDSHM_PREVIEW_MAGIC, __ATOMIC_RELEASE);
+    }
+    else if (__atomic_load_n(&preview->magic, __ATOMIC_ACQUIRE) != LEDSHM_PREVIEW_MAGIC || preview->version != LEDSHM_PREVIEW_VERSION)
+    {
+        munmap(preview, sizeof(SharedPreview));
+        return NULL;
+    }
+    return preview;
+}
+
+static inline void ledshm_preview_close(SharedPreview *preview)
+{
+    if (preview != NULL)
+        munmap(preview, sizeof(SharedPreview));
+}
+
+// Writer side (the daemon)
+static inline void ledshm_preview_publish(SharedPreview *preview, const uint32_t *colors)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    PreviewFrame *frame = &preview->buffers[preview->back];
+    frame->timestamp_ns = (uint64_t)now.tv_sec * 1000000000ULL + now.tv_nsec;
+    frame->seq = ++preview->seq;
+    memcpy(frame->colors, colors, sizeof(frame->colors));
+
+    uint32_t old = __atomic_exchange_n(&preview->middle, preview->back | LEDSHM_PREVIEW_FRESH, __ATOMIC_ACQ_REL);
+    preview->back = old & 3;
+}
+
+// Reader side: returns the newest frame, or NULL when nothing was published since the last call.
+// The frame stays valid until the next call.
+static inline const PreviewFrame *ledshm_preview_latest(SharedPreview *preview)
+{
+    if (!(__atomic_load_n(&preview->middle, __ATOMIC_ACQUIRE) & LEDSHM_PREVIEW_FRESH))
+        return NULL;
+
+    uint32_t old = __atomic_exchange_n(&preview->middle, preview->front, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&preview->front, old & 3, __ATOMIC_RELEASE);
+    return &preview->buffers[old & 3];
+}
+
+#endif
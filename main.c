@@ -13,6 +13,11 @@
 #include <dirent.h>
 #include <string.h>
 #include <time.h>
+#include <errno.h>
+#include <libgen.h>
+#include <math.h>
+
+#include "ledshm.h"
 
 #define NUM_OPTIONS 2
 #define MAX_NAME_LEN 50
@@ -27,6 +32,7 @@ typedef struct
     int maxeffects;
     int brightness;
     int trigger;
+    char triggers[LEDSHM_TRIGGERS_LEN]; // Not edited here: kept as read, so that saving does not drop it
 } LightSettings;
 
 LightSettings lights[NUM_OPTIONS];
@@ -36,11 +42,31 @@ const char *lightnames[] = {
 const char *triggernames[] = {
     "B", "A", "Y", "X", "L", "R", "SELECT", "START", "MENU", "ALL", "LR", "DPAD"};
 
+SharedSettings *shared_settings = NULL; // Live settings read by lcdaemon on its next frame
+
+#define SETTINGS_SAVE_DEBOUNCE_MS 1000
+#define SETTINGS_MAX_SIZE 2048
+
+// Coalesces settings changes before they reach the SD card
+typedef struct
+{
+    bool dirty;          // Changed since the last flush
+    Uint32 changed_at;   // SDL ticks of the last change
+    int changes;         // Number of changes requested
+    int writes;          // Number of files actually written
+    int unchanged;       // Flushes skipped because the content on disk was identical
+    char last[SETTINGS_MAX_SIZE]; // Content currently on disk
+    int last_len;
+} SettingsStore;
+
+SettingsStore settings_store = {0};
+
 const char *effect_names[] = {
     "Linear", "Breathe", "Interval Breathe", "Static", "Blink 1", "Blink 2", "Blink 3", "Color Drift", // 1-8  native effects from LED driver
     "Twinkle", "Fire", "Glitter", "NeonGlow", "Firefly", "Aurora", "Reactive",                         // 9-15 effect logic managed by LED controller daemon
     "Battery Level", "CPU Speed", "CPU Temperature", "Ambilight", "Nothing",                           // 16-20 Effects from CrossMix
-    "Rainbow Snake", "Rotation", "Rotation Mirror", "Directions"};                                     // 21-24 Effects requiring effect_rgb_hex_lr, exclusive to “lr” light.
+    "Rainbow Snake", "Rotation", "Rotation Mirror", "Directions",                                      // 21-24 Effects requiring effect_rgb_hex_lr, exclusive to “lr” light.
+    "Stick Tracker", "Audio Spectrum"};                                                                // 25-26 Driven by the analog sticks / the sound, "lr" light
 
 int read_settings(const char *filename, LightSettings *lights, int max_lights)
 {
@@ -117,6 +143,8 @@ int read_settings(const char *filename, LightSettings *lights, int max_lights)
                 lights[current_light].trigger = temp_value;
                 continue;
             }
+            if (sscanf(line, "triggers=%63[^\r\n]", lights[current_light].triggers) == 1)
+                continue;
         }
     }
 
@@ -124,33 +152,161 @@ int read_settings(const char *filename, LightSettings *lights, int max_lights)
     return 0;
 }
 
+int serialize_settings(char *buffer, int size, LightSettings *lights, int max_lights)
+{
+    int len = 0;
+    for (int i = 0; i < max_lights && len < size; ++i)
+    {
+        len += snprintf(buffer + len, size - len,
+                        "[%s]\n"
+                        "effect=%d\n"
+                        "color=0x%06X\n"
+                        "color2=0x%06X\n"
+                        "duration=%d\n"
+                        "maxeffects=%d\n"
+                        "brightness=%d\n"
+                        "trigger=%d\n",
+                        lights[i].name, lights[i].effect, lights[i].color, lights[i].color2,
+                        lights[i].duration, lights[i].maxeffects, lights[i].brightness, lights[i].trigger);
+        if (lights[i].triggers[0] != '\0' && len < size)
+            len += snprintf(buffer + len, size - len, "triggers=%s\n", lights[i].triggers);
+        if (len < size)
+            len += snprintf(buffer + len, size - len, "\n");
+    }
+    return len < size ? len : size - 1;
+}
+
+// Remembers what is currently on disk so that identical content is never rewritten
+void load_settings_snapshot(const char *filename)
+{
+    char diskfilename[256];
+    snprintf(diskfilename, sizeof(diskfilename), "/mnt/SDCARD/System/etc/%s", filename);
+
+    settings_store.last_len = -1;
+    int fd = open(diskfilename, O_RDONLY);
+    if (fd < 0)
+        return;
+    int len = read(fd, settings_store.last, sizeof(settings_store.last));
+    close(fd);
+    if (len >= 0 && len < (int)sizeof(settings_store.last))
+        settings_store.last_len = len;
+}
+
+// Writes the settings to a temporary file, syncs it and renames it over the old one,
+// so that a crash or power loss leaves either the old or the new file but never a truncated one.
 int save_settings(const char *filename, LightSettings *lights, int max_lights)
 {
+    char buffer[SETTINGS_MAX_SIZE];
+    int len = serialize_settings(buffer, sizeof(buffer), lights, max_lights);
+
+    if (len == settings_store.last_len && memcmp(buffer, settings_store.last, len) == 0)
+    {
+        settings_store.unchanged++;
+        return 0;
+    }
+
     char diskfilename[256];
+    char tmpfilename[256];
     snprintf(diskfilename, sizeof(diskfilename), "/mnt/SDCARD/System/etc/%s", filename);
-    FILE *file = fopen(diskfilename, "w");
-    if (file == NULL)
+    snprintf(tmpfilename, sizeof(tmpfilename), "%s.tmp", diskfilename);
+
+    int fd = open(tmpfilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
     {
         perror("Unable to open settings file for writing");
         return 1;
     }
 
-    for (int i = 0; i < max_lights; ++i)
+    int written = 0;
+    while (written < len)
     {
-        fprintf(file, "[%s]\n", lights[i].name);
-        fprintf(file, "effect=%d\n", lights[i].effect);
-        fprintf(file, "color=0x%06X\n", lights[i].color);
-        fprintf(file, "color2=0x%06X\n", lights[i].color2);
-        fprintf(file, "duration=%d\n", lights[i].duration);
-        fprintf(file, "maxeffects=%d\n", lights[i].maxeffects);
-        fprintf(file, "brightness=%d\n", lights[i].brightness);
-        fprintf(file, "trigger=%d\n\n", lights[i].trigger);
+        int ret = write(fd, buffer + written, len - written);
+        if (ret < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            perror("Unable to write settings file");
+            close(fd);
+            unlink(tmpfilename);
+            return 1;
+        }
+        written += ret;
     }
 
-    fclose(file);
+    int synced = fsync(fd);
+    int closed = close(fd); // Always closed, even when the sync failed
+    if (synced != 0 || closed != 0)
+    {
+        perror("Unable to sync settings file");
+        unlink(tmpfilename);
+        return 1;
+    }
+
+    if (rename(tmpfilename, diskfilename) != 0)
+    {
+        perror("Unable to replace settings file");
+        unlink(tmpfilename);
+        return 1;
+    }
+
+    // Make the rename itself durable
+    int dirfd = open(dirname(tmpfilename), O_RDONLY | O_DIRECTORY);
+    if (dirfd >= 0)
+    {
+        fsync(dirfd);
+        close(dirfd);
+    }
+
+    memcpy(settings_store.last, buffer, len);
+    settings_store.last_len = len;
+    settings_store.writes++;
     return 0;
 }
 
+void mark_settings_dirty()
+{
+    settings_store.dirty = true;
+    settings_store.changed_at = SDL_GetTicks();
+    settings_store.changes++;
+}
+
+// Writes pending changes, immediately when force is set or once the user paused for the debounce window
+void flush_settings(bool force)
+{
+    if (!settings_store.dirty)
+        return;
+    if (!force && SDL_GetTicks() - settings_store.changed_at < SETTINGS_SAVE_DEBOUNCE_MS)
+        return;
+
+    if (save_settings("led_daemon.conf", lights, NUM_OPTIONS) == 0)
+        settings_store.dirty = false;
+}
+
+// Publishes the current settings to the daemon through shared memory (no file I/O)
+void publish_settings(LightSettings *lights, int max_lights)
+{
+    if (shared_settings == NULL)
+        return;
+
+    SharedLightSettings shared[LEDSHM_MAX_LIGHTS];
+    if (max_lights > LEDSHM_MAX_LIGHTS)
+        max_lights = LEDSHM_MAX_LIGHTS;
+
+    memset(shared, 0, sizeof(shared));
+    for (int i = 0; i < max_lights; ++i)
+    {
+        strncpy(shared[i].name, lights[i].name, LEDSHM_NAME_LEN - 1);
+        shared[i].effect = lights[i].effect;
+        shared[i].color = lights[i].color;
+        shared[i].color2 = lights[i].color2;
+        shared[i].duration = lights[i].duration;
+        shared[i].brightness = lights[i].brightness;
+        shared[i].trigger = lights[i].trigger;
+        strncpy(shared[i].triggers, lights[i].triggers, LEDSHM_TRIGGERS_LEN - 1);
+    }
+    ledshm_settings_write(shared_settings, shared, max_lights);
+}
+
 void handle_light_input(LightSettings *light, SDL_Event *event, int selected_setting)
 {
     const uint32_t bright_colors[] = {
@@ -329,67 +485,249 @@ void handle_light_input(LightSettings *light, SDL_Event *event, int selected_set
         break;
     }
 
-    // Save settings after each change
+    // The daemon picks up the change on its next frame, the SD card is only written once the user pauses
+    publish_settings(lights, NUM_OPTIONS);
+    mark_settings_dirty();
+}
+
+// =========== Shape cache ===========
+// Rounded rectangles are rasterized once, anti-aliased, as white alpha masks and then only tinted
+// with the current draw color: one texture copy per shape instead of a draw call per corner pixel.
+
+#define SHAPE_CACHE_ENTRIES 8
+
+typedef struct
+{
+    SDL_Texture *texture;
+    int w;
+    int h;
+    int radius;
+} CachedShape;
+
+CachedShape shape_cache[SHAPE_CACHE_ENTRIES];
 
-    save_settings("led_daemon.conf", lights, NUM_OPTIONS);
+// Coverage of pixel (px, py) by a w x h rectangle with rounded corners, from 0 to 255
+Uint8 rounded_rect_coverage(int px, int py, int w, int h, int radius)
+{
+    // Distance from the pixel center to the nearest corner circle center, 0 outside the corners
+    float cx = px + 0.5f;
+    float cy = py + 0.5f;
+    float dx = cx < radius ? radius - cx : (cx > w - radius ? cx - (w - radius) : 0);
+    float dy = cy < radius ? radius - cy : (cy > h - radius ? cy - (h - radius) : 0);
+    if (dx == 0 || dy == 0)
+        return 255;
+
+    float coverage = radius - sqrtf(dx * dx + dy * dy) + 0.5f;
+    if (coverage <= 0)
+        return 0;
+    if (coverage >= 1)
+        return 255;
+    return (Uint8)(coverage * 255);
 }
 
-void draw_filled_circle(SDL_Renderer *renderer, int x, int y, int radius)
+SDL_Texture *get_rounded_rect(SDL_Renderer *renderer, int w, int h, int radius)
 {
-    for (int w = 0; w < radius * 2; w++)
+    CachedShape *free_entry = NULL;
+    for (int i = 0; i < SHAPE_CACHE_ENTRIES; i++)
     {
-        for (int h = 0; h < radius * 2; h++)
+        CachedShape *entry = &shape_cache[i];
+        if (entry->texture == NULL)
         {
-            int dx = radius - w; // horizontal offset
-            int dy = radius - h; // vertical offset
-            if ((dx * dx + dy * dy) <= (radius * radius))
-            {
-                SDL_RenderDrawPoint(renderer, x + dx, y + dy);
-            }
+            if (free_entry == NULL)
+                free_entry = entry;
         }
+        else if (entry->w == w && entry->h == h && entry->radius == radius)
+        {
+            return entry->texture;
+        }
+    }
+    if (free_entry == NULL)
+    {
+        // Only a handful of sizes are used by the UI, start over if that ever changes
+        free_entry = &shape_cache[0];
+        SDL_DestroyTexture(free_entry->texture);
+        free_entry->texture = NULL;
+    }
+
+    SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormat(0, w, h, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!surface)
+        return NULL;
+
+    for (int py = 0; py < h; py++)
+    {
+        Uint32 *row = (Uint32 *)((Uint8 *)surface->pixels + py * surface->pitch);
+        for (int px = 0; px < w; px++)
+        {
+            row[px] = ((Uint32)rounded_rect_coverage(px, py, w, h, radius) << 24) | 0xFFFFFF;
+        }
+    }
+
+    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
+    SDL_FreeSurface(surface);
+    if (!texture)
+        return NULL;
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+    free_entry->texture = texture;
+    free_entry->w = w;
+    free_entry->h = h;
+    free_entry->radius = radius;
+    return texture;
+}
+
+void clear_shape_cache()
+{
+    for (int i = 0; i < SHAPE_CACHE_ENTRIES; i++)
+    {
+        if (shape_cache[i].texture)
+            SDL_DestroyTexture(shape_cache[i].texture);
+        shape_cache[i].texture = NULL;
     }
 }
 
-// Function to draw a rounded rectangle
+// Function to draw a rounded rectangle in the current draw color
 void draw_rounded_rect(SDL_Renderer *renderer, int x, int y, int w, int h, int radius)
 {
-    // Draw the central part of the rectangle
-    SDL_Rect rect = {x + radius, y, w - 2 * radius, h};
-    SDL_RenderFillRect(renderer, &rect);
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
 
-    rect.x = x;
-    rect.y = y + radius;
-    rect.w = w;
-    rect.h = h - 2 * radius;
-    SDL_RenderFillRect(renderer, &rect);
+    SDL_Texture *shape = get_rounded_rect(renderer, w, h, radius);
+    if (!shape)
+    {
+        SDL_Rect rect = {x, y, w, h};
+        SDL_RenderFillRect(renderer, &rect);
+        return;
+    }
 
-    // Draw the corners
-    draw_filled_circle(renderer, x + radius, y + radius, radius);                 // Top-left corner
-    draw_filled_circle(renderer, x + w - radius - 1, y + radius, radius);         // Top-right corner
-    draw_filled_circle(renderer, x + radius, y + h - radius - 1, radius);         // Bottom-left corner
-    draw_filled_circle(renderer, x + w - radius - 1, y + h - radius - 1, radius); // Bottom-right corner
+    SDL_SetTextureColorMod(shape, r, g, b);
+    SDL_SetTextureAlphaMod(shape, a);
+    SDL_Rect dstrect = {x, y, w, h};
+    SDL_RenderCopy(renderer, shape, NULL, &dstrect);
 }
 
 char last_button_pressed[50] = "None";
 
-char *read_effect_description(const char *effect_name)
+// =========== Effect descriptions ===========
+// All descriptions are read once at startup into a single arena. Lines are split in place
+// and wrapped to the panel width the first time an effect is displayed.
+
+#define NUM_EFFECTS (int)(sizeof(effect_names) / sizeof(effect_names[0]))
+#define MAX_DESCRIPTION_SIZE 1023
+#define MAX_DESCRIPTION_LINES 32
+
+typedef struct
 {
-    static char buffer[1024];
-    memset(buffer, 0, sizeof(buffer));
+    const char *lines[MAX_DESCRIPTION_LINES]; // Point into description_arena
+    int line_count;
+    bool wrapped;
+} EffectDescription;
+
+char *description_arena = NULL;
+EffectDescription descriptions[NUM_EFFECTS];
 
+void load_effect_descriptions()
+{
+    static const char missing[] = "No description available.";
     char path[256];
-    snprintf(path, sizeof(path), "./effect_desc/%s.txt", effect_name);
+    size_t sizes[NUM_EFFECTS];
+    size_t total = 0;
 
-    FILE *f = fopen(path, "r");
-    if (!f)
+    for (int i = 0; i < NUM_EFFECTS; i++)
     {
-        snprintf(buffer, sizeof(buffer), "No description available.");
-        return buffer;
+        struct stat st;
+        snprintf(path, sizeof(path), "./effect_desc/%s.txt", effect_names[i]);
+        sizes[i] = stat(path, &st) == 0 ? st.st_size : 0;
+        if (sizes[i] > MAX_DESCRIPTION_SIZE)
+            sizes[i] = MAX_DESCRIPTION_SIZE;
+        // Room for the placeholder too, the file may still turn out unreadable or empty
+        total += (sizes[i] > sizeof(missing) ? sizes[i] : sizeof(missing)) + 1;
     }
 
-    fread(buffer, 1, sizeof(buffer) - 1, f);
-    fclose(f);
-    return buffer;
+    description_arena = malloc(total);
+    if (description_arena == NULL)
+        return;
+
+    char *text = description_arena;
+    for (int i = 0; i < NUM_EFFECTS; i++)
+    {
+        size_t len = 0;
+        snprintf(path, sizeof(path), "./effect_desc/%s.txt", effect_names[i]);
+        int fd = sizes[i] ? open(path, O_RDONLY) : -1;
+        if (fd >= 0)
+        {
+            ssize_t ret;
+            while (len < sizes[i] && (ret = read(fd, text + len, sizes[i] - len)) > 0)
+                len += ret;
+            close(fd);
+        }
+        if (len == 0)
+        {
+            memcpy(text, missing, sizeof(missing));
+            len = sizeof(missing) - 1;
+        }
+        text[len] = '\0';
+
+        // Split lines in place, empty lines are skipped as before
+        EffectDescription *desc = &descriptions[i];
+        desc->line_count = 0;
+        for (char *line = text; line < text + len && desc->line_count < MAX_DESCRIPTION_LINES;)
+        {
+            char *end = strchr(line, '\n');
+            if (end == NULL)
+                end = text + len;
+            *end = '\0';
+            if (end > line && end[-1] == '\r')
+                end[-1] = '\0';
+            if (*line != '\0')
+                desc->lines[desc->line_count++] = line;
+            line = end + 1;
+        }
+        text += len + 1;
+    }
+}
+
+// Breaks lines wider than max_width at their last fitting space, in place
+void wrap_effect_description(EffectDescription *desc, TTF_Font *font, int max_width)
+{
+    const char *wrapped[MAX_DESCRIPTION_LINES];
+    int count = 0;
+
+    for (int i = 0; i < desc->line_count && count < MAX_DESCRIPTION_LINES; i++)
+    {
+        char *line = (char *)desc->lines[i];
+        while (line != NULL && count < MAX_DESCRIPTION_LINES)
+        {
+            int w = 0;
+            char *split = NULL;
+            if (TTF_SizeText(font, line, &w, NULL) == 0 && w > max_width)
+            {
+                for (char *space = strchr(line + 1, ' '); space != NULL; space = strchr(space + 1, ' '))
+                {
+                    *space = '\0';
+                    bool fits = TTF_SizeText(font, line, &w, NULL) == 0 && w <= max_width;
+                    *space = ' ';
+                    if (!fits)
+                        break;
+                    split = space;
+                }
+            }
+
+            wrapped[count++] = line;
+            if (split != NULL)
+            {
+                *split = '\0';
+                line = split + 1;
+            }
+            else
+            {
+                line = NULL;
+            }
+        }
+    }
+
+    memcpy(desc->lines, wrapped, count * sizeof(wrapped[0]));
+    desc->line_count = count;
+    desc->wrapped = true;
 }
 
 int get_mainui_brightness()
@@ -417,21 +755,559 @@ int get_mainui_brightness()
     return cached_value;
 }
 
-int main(int argc, char *argv[])
+// =========== Text texture cache ===========
+// Labels almost never change between frames: keep their textures instead of
+// rasterizing and uploading them again on every frame. Least recently used entries
+// are evicted once the cache exceeds its entry count or its byte budget.
+
+#define TEXT_CACHE_ENTRIES 96
+#define TEXT_CACHE_BUDGET (8 * 1024 * 1024) // bytes of texture memory (32 bpp)
+#define TEXT_CACHE_KEY_LEN 256
+
+typedef struct
+{
+    char text[TEXT_CACHE_KEY_LEN];
+    TTF_Font *font;
+    int style;
+    Uint32 color;
+    bool blended;
+    SDL_Texture *texture; // NULL when the entry is free
+    int w;
+    int h;
+    int bytes;
+    Uint32 last_used;
+} CachedText;
+
+CachedText text_cache[TEXT_CACHE_ENTRIES];
+int text_cache_bytes = 0;
+Uint32 text_cache_clock = 0;
+unsigned long texture_uploads = 0; // Textures created from text since the last report
+
+void free_cached_text(CachedText *entry)
+{
+    SDL_DestroyTexture(entry->texture);
+    text_cache_bytes -= entry->bytes;
+    entry->texture = NULL;
+}
+
+// Returns the texture of text rendered with font/color, rendering and uploading it only on a cache miss.
+// The entry stays valid until the next call.
+CachedText *get_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, SDL_Color color, bool blended)
+{
+    if (font == NULL)
+        return NULL; // Fonts are still loading
+    int style = TTF_GetFontStyle(font);
+    Uint32 color_key = (color.r << 24) | (color.g << 16) | (color.b << 8) | color.a;
+    CachedText *free_entry = NULL;
+    CachedText *oldest = NULL;
+
+    for (int i = 0; i < TEXT_CACHE_ENTRIES; i++)
+    {
+        CachedText *entry = &text_cache[i];
+        if (entry->texture == NULL)
+        {
+            if (free_entry == NULL)
+                free_entry = entry;
+            continue;
+        }
+        if (entry->font == font && entry->style == style && entry->color == color_key &&
+            entry->blended == blended && strcmp(entry->text, text) == 0)
+        {
+            entry->last_used = ++text_cache_clock;
+            return entry;
+        }
+        if (oldest == NULL || entry->last_used < oldest->last_used)
+            oldest = entry;
+    }
+
+    SDL_Surface *surface = blended ? TTF_RenderText_Blended(font, text, color) : TTF_RenderText_Solid(font, text, color);
+    if (surface == NULL)
+        return NULL;
+
+    int bytes = surface->w * surface->h * 4;
+    while (text_cache_bytes + bytes > TEXT_CACHE_BUDGET || free_entry == NULL)
+    {
+        // Evict the least recently used entries
+        if (free_entry == NULL && oldest != NULL)
+        {
+            free_cached_text(oldest);
+            free_entry = oldest;
+            oldest = NULL;
+            continue;
+        }
+        CachedText *victim = NULL;
+        for (int i = 0; i < TEXT_CACHE_ENTRIES; i++)
+        {
+            if (text_cache[i].texture != NULL && (victim == NULL || text_cache[i].last_used < victim->last_used))
+                victim = &text_cache[i];
+        }
+        if (victim == NULL)
+            break;
+        free_cached_text(victim);
+    }
+
+    CachedText *entry = free_entry;
+    entry->texture = SDL_CreateTextureFromSurface(renderer, surface);
+    entry->w = surface->w;
+    entry->h = surface->h;
+    SDL_FreeSurface(surface);
+    if (entry->texture == NULL)
+        return NULL;
+
+    strncpy(entry->text, text, TEXT_CACHE_KEY_LEN - 1);
+    entry->text[TEXT_CACHE_KEY_LEN - 1] = '\0';
+    entry->font = font;
+    entry->style = style;
+    entry->color = color_key;
+    entry->blended = blended;
+    entry->bytes = bytes;
+    entry->last_used = ++text_cache_clock;
+    text_cache_bytes += bytes;
+    texture_uploads++;
+    return entry;
+}
+
+// Draws text at x, y and returns its size
+void draw_text(SDL_Renderer *renderer, TTF_Font *font, const char *text, SDL_Color color, bool blended, int x, int y, int *w, int *h)
+{
+    CachedText *entry = get_text(renderer, font, text, color, blended);
+    if (entry == NULL)
+        return;
+
+    SDL_Rect dstrect = {x, y, entry->w, entry->h};
+    SDL_RenderCopy(renderer, entry->texture, NULL, &dstrect);
+    if (w)
+        *w = entry->w;
+    if (h)
+        *h = entry->h;
+}
+
+void clear_text_cache()
+{
+    for (int i = 0; i < TEXT_CACHE_ENTRIES; i++)
+    {
+        if (text_cache[i].texture != NULL)
+            free_cached_text(&text_cache[i]);
+    }
+}
+
+// =========== Retained UI ===========
+// The screen is kept in a target texture and only the widgets marked dirty are repainted into it.
+// When nothing is dirty the main loop blocks on events instead of redrawing.
+
+enum
+{
+    WIDGET_TITLE,
+    WIDGET_ROW, // One per setting row: WIDGET_ROW + 0..NUM_SETTINGS-1
+    WIDGET_FOOTER = WIDGET_ROW + 6,
+    WIDGET_DESCRIPTION,
+    WIDGET_PREVIEW,
+    NUM_WIDGETS
+};
+
+#define NUM_SETTINGS 6
+#define DIRTY(widget) (1u << (widget))
+#define DIRTY_ALL ((1u << NUM_WIDGETS) - 1)
+
+Uint32 dirty_widgets = DIRTY_ALL;
+
+const SDL_Color white_color = {255, 255, 255, 255};
+const SDL_Color dark_color = {32, 36, 32, 255};
+const SDL_Color black_color = {0, 0, 0, 255};
+
+SDL_Color hex_to_sdl_color(uint32_t hex)
+{
+    SDL_Color color;
+    color.r = (hex >> 16) & 0xFF;
+    color.g = (hex >> 8) & 0xFF;
+    color.b = hex & 0xFF;
+    color.a = 255;
+    return color;
+}
+
+void clear_area(SDL_Renderer *renderer, SDL_Rect area)
+{
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    SDL_RenderFillRect(renderer, &area);
+}
+
+// Display light name
+void draw_title(SDL_Renderer *renderer, TTF_Font *font, int window_width, const LightSettings *light)
+{
+    clear_area(renderer, (SDL_Rect){0, 0, window_width, 93});
+
+    TTF_SetFontStyle(font, TTF_STYLE_BOLD);
+    CachedText *title = get_text(renderer, font, light->friendlyname, white_color, true);
+    if (title)
+    {
+        // Centered coordinates for text
+        int center_x = (window_width - title->w) / 2;
+        int center_y = 30;
+
+        // Background rectangle: full width, height-adjusted
+        SDL_Rect bg_rect = {
+            .x = 0,
+            .y = center_y - 5,
+            .w = window_width,
+            .h = title->h + 10};
+        SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255); // Dark grey
+        SDL_RenderFillRect(renderer, &bg_rect);
+
+        // Display centered text
+        SDL_Rect dstrect = {
+            .x = center_x,
+            .y = center_y,
+            .w = title->w,
+            .h = title->h};
+        SDL_RenderCopy(renderer, title->texture, NULL, &dstrect);
+    }
+
+    // Reset style
+    TTF_SetFontStyle(font, TTF_STYLE_NORMAL);
+}
+
+void draw_color_swatch(SDL_Renderer *renderer, int x, int y, uint32_t color)
+{
+    int cube_w = 56;
+    int cube_h = 56;
+    int corner_radius = 10;
+
+    // Step 1: draw the slightly larger black background
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+    draw_rounded_rect(renderer, x - 1, y - 1, cube_w + 2, cube_h + 2, corner_radius + 1);
+
+    // Step 2: Draw the coloured cube on top
+    SDL_Color color_cube = hex_to_sdl_color(color);
+    SDL_SetRenderDrawColor(renderer, color_cube.r, color_cube.g, color_cube.b, color_cube.a);
+    draw_rounded_rect(renderer, x, y, cube_w, cube_h, corner_radius);
+}
+
+// Display one setting, clipped so that it never covers the description panel
+void draw_setting_row(SDL_Renderer *renderer, TTF_Font *font, int window_width, const LightSettings *light, int j, bool selected)
 {
+    const char *settings_labels[NUM_SETTINGS] = {"Effect", "Color1", "Color2", "Speed", "Brightness", "Trigger"};
+    int settings_values[NUM_SETTINGS] = {
+        light->effect,
+        light->color,
+        light->color2,
+        light->duration,
+        light->brightness,
+        light->trigger,
+    };
+
+    SDL_Rect area = {0, 112 + j * 82, window_width / 2 + 20, 68};
+    clear_area(renderer, area);
+    SDL_RenderSetClipRect(renderer, &area);
+
+    char setting_text[256];
+    SDL_Color bgcolor = selected ? white_color : black_color;
+    SDL_Color current_color = selected ? black_color : white_color;
+
+    if (j == 0)
+    { // Display effect name instead of number
+        snprintf(setting_text, sizeof(setting_text), "%s: %s",
+                 settings_labels[j],
+                 effect_names[settings_values[j] - 1]);
+    }
+    else if (j < 3)
+    { // Display color as a swatch
+        snprintf(setting_text, sizeof(setting_text), "%s:", settings_labels[j]);
+    }
+    else if (j == 5)
+    { // Display trigger name instead of number
+        snprintf(setting_text, sizeof(setting_text), "%s: %s", settings_labels[j], triggernames[settings_values[j] - 1]);
+    }
+    else if (j == 4 && settings_values[j] == -1)
+    {
+        int brightness_from_ui = get_mainui_brightness();
+        snprintf(setting_text, sizeof(setting_text), "%s: %d (MainUI)", settings_labels[j], brightness_from_ui);
+    }
+    else
+    {
+        snprintf(setting_text, sizeof(setting_text), "%s: %d", settings_labels[j], settings_values[j]);
+    }
+
+    CachedText *text = get_text(renderer, font, setting_text, current_color, false);
+    if (text)
+    {
+        SDL_SetRenderDrawColor(renderer, bgcolor.r, bgcolor.g, bgcolor.b, 255);
+        SDL_Rect rect = {20, 112 + j * 82, text->w + (j > 0 && j < 3 ? 130 : 60), 68};
+        SDL_RenderFillRect(renderer, &rect);
+
+        SDL_Rect dstrect = {50, 122 + j * 82, text->w, text->h};
+        SDL_RenderCopy(renderer, text->texture, NULL, &dstrect);
+
+        if (j > 0 && j < 3)
+            draw_color_swatch(renderer, 30 + text->w + 30, 118 + j * 82, settings_values[j]);
+    }
+
+    SDL_RenderSetClipRect(renderer, NULL);
+}
+
+// Font-less setting row drawn from the settings cached in shared memory until the loader is done:
+// the selection bar and the color swatches show up right away, the labels come with the fonts
+void draw_cached_row(SDL_Renderer *renderer, int window_width, const SharedLightSettings *light, int j, bool selected)
+{
+    SDL_Rect area = {0, 112 + j * 82, window_width / 2 + 20, 68};
+    clear_area(renderer, area);
+    SDL_RenderSetClipRect(renderer, &area);
+
+    if (selected)
+    {
+        SDL_SetRenderDrawColor(renderer, white_color.r, white_color.g, white_color.b, 255);
+        SDL_Rect rect = {20, 112 + j * 82, 300, 68};
+        SDL_RenderFillRect(renderer, &rect);
+    }
+    if (j > 0 && j < 3)
+        draw_color_swatch(renderer, 200, 118 + j * 82, j == 1 ? light->color : light->color2);
+
+    SDL_RenderSetClipRect(renderer, NULL);
+}
+
+void draw_footer(SDL_Renderer *renderer, TTF_Font *fontsm, int window_width, int window_height)
+{
+    clear_area(renderer, (SDL_Rect){0, window_height - 95, window_width, 95});
+
+    SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
+    SDL_Rect rect = {20, window_height - 95, 350, 80};
+    SDL_RenderFillRect(renderer, &rect);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    rect = (SDL_Rect){30, window_height - 85, 100, 60};
+    SDL_RenderFillRect(renderer, &rect);
+    draw_text(renderer, fontsm, "L/R", dark_color, false, 50, window_height - 76, NULL, NULL);
+    draw_text(renderer, fontsm, "Light select", white_color, false, 140, window_height - 78, NULL, NULL);
+
+    SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
+    rect = (SDL_Rect){window_width - 190, window_height - 95, 170, 80};
+    SDL_RenderFillRect(renderer, &rect);
+    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+    rect = (SDL_Rect){window_width - 180, window_height - 85, 60, 60};
+    SDL_RenderFillRect(renderer, &rect);
+    draw_text(renderer, fontsm, "B", dark_color, false, window_width - 160, window_height - 78, NULL, NULL);
+    draw_text(renderer, fontsm, "Quit", white_color, false, window_width - 110, window_height - 78, NULL, NULL);
+}
+
+// =========== Display effect description ===========
+void draw_description(SDL_Renderer *renderer, TTF_Font *fontsm, int window_width, int window_height, const LightSettings *light)
+{
+    int effect_index = light ? light->effect - 1 : -1; // No light while settings are loading
+
+    // Frame on right
+    int box_x = window_width / 2 + 20;
+    int box_y = 93;
+    int box_w = window_width / 2 - 60;
+    int box_h = window_height - 200;
+
+    SDL_Rect desc_box = {box_x, box_y, box_w, box_h};
+    SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
+    SDL_RenderFillRect(renderer, &desc_box);
+
+    // Multiline text
+    if (effect_index >= 0 && effect_index < NUM_EFFECTS)
+    {
+        EffectDescription *desc = &descriptions[effect_index];
+        if (!desc->wrapped && fontsm)
+            wrap_effect_description(desc, fontsm, box_w - 20);
+
+        int line_height = 36;
+        int max_lines = box_h / line_height;
+        for (int line_num = 0; line_num < desc->line_count && line_num < max_lines; line_num++)
+        {
+            draw_text(renderer, fontsm, desc->lines[line_num], white_color, true, box_x + 10, box_y + 10 + line_num * line_height, NULL, NULL);
+        }
+    }
+}
+
+// =========== Live LED preview ===========
+// lcdaemon publishes every frame it sends to the LEDs into a triple buffer (see ledshm.h).
+// Taking the newest one is a couple of atomic operations: no lock, no syscall, no file read.
+
+#define PREVIEW_ACTIVE_MS 16   // Poll at display rate while the LEDs are changing
+#define PREVIEW_IDLE_MS 250    // ...and slowly once they settled
+#define PREVIEW_SETTLE_MS 1000 // Time without a new frame before going idle
+
+SharedPreview *preview = NULL;
+uint32_t preview_colors[LEDSHM_LED_COUNT];
+Uint32 preview_changed_at = 0;
+Uint32 preview_attach_at = 0;
+
+// Returns true when the LEDs changed since the last call
+bool poll_preview()
+{
+    if (preview == NULL)
+    {
+        // The daemon creates the buffer, retry now and then until it is there
+        if (SDL_GetTicks() - preview_attach_at < PREVIEW_SETTLE_MS && preview_attach_at != 0)
+            return false;
+        preview_attach_at = SDL_GetTicks();
+        preview = ledshm_preview_open(0);
+        if (preview == NULL)
+            return false;
+    }
+
+    const PreviewFrame *frame = ledshm_preview_latest(preview);
+    if (frame == NULL || memcmp(preview_colors, frame->colors, sizeof(preview_colors)) == 0)
+        return false;
+
+    memcpy(preview_colors, frame->colors, sizeof(preview_colors));
+    preview_changed_at = SDL_GetTicks();
+    return true;
+}
+
+// How long the main loop may sleep before the preview needs to be polled again
+int preview_timeout()
+{
+    if (preview == NULL)
+        return PREVIEW_SETTLE_MS;
+    return SDL_GetTicks() - preview_changed_at < PREVIEW_SETTLE_MS ? PREVIEW_ACTIVE_MS : PREVIEW_IDLE_MS;
+}
+
+void draw_preview_led(SDL_Renderer *renderer, int x, int y, int size, uint32_t color)
+{
+    SDL_Color led = hex_to_sdl_color(color);
+    if (color == 0)
+        led = (SDL_Color){40, 40, 40, 255}; // Keep the layout visible when a LED is off
+    SDL_SetRenderDrawColor(renderer, led.r, led.g, led.b, 255);
+    draw_rounded_rect(renderer, x - size / 2, y - size / 2, size, size, size / 2);
+}
+
+// Centre light between the two stick rings. Per ring, LEDs 1-3 are on the left, 4-5 at the bottom,
+// 6-8 on the right and 9-11 at the top (12-22 for the right ring).
+void draw_preview(SDL_Renderer *renderer, int window_width, int window_height)
+{
+    SDL_Rect area = {390, window_height - 95, window_width - 210 - 390, 80};
+    SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
+    SDL_RenderFillRect(renderer, &area);
+    if (preview == NULL)
+        return;
+
+    int center_x = area.x + area.w / 2;
+    int center_y = area.y + area.h / 2;
+    int ring_radius = 30;
+    int ring_offset = area.w / 4;
+
+    draw_preview_led(renderer, center_x, center_y, 24, preview_colors[0]);
+    for (int k = 1; k <= 11; k++)
+    {
+        float angle = (180.0f + (k - 2) * 360.0f / 11) * (float)M_PI / 180.0f;
+        int dx = (int)lroundf(ring_radius * cosf(angle));
+        int dy = (int)lroundf(-ring_radius * sinf(angle));
+        draw_preview_led(renderer, center_x - ring_offset + dx, center_y + dy, 12, preview_colors[k]);
+        draw_preview_led(renderer, center_x + ring_offset + dx, center_y + dy, 12, preview_colors[k + 11]);
+    }
+}
+
+// Moves the selection and marks what has to be repainted
+void select_setting(int *selected_setting, int setting)
+{
+    dirty_widgets |= DIRTY(WIDGET_ROW + *selected_setting) | DIRTY(WIDGET_ROW + setting);
+    *selected_setting = setting;
+}
+
+void select_light(int *selected_light, int light)
+{
+    *selected_light = light;
+    dirty_widgets = DIRTY_ALL;
+}
+
+void change_setting(LightSettings *light, SDL_Event *event, int selected_setting)
+{
+    handle_light_input(light, event, selected_setting);
+    dirty_widgets |= DIRTY(WIDGET_ROW + selected_setting);
+    if (selected_setting == 0)
+        dirty_widgets |= DIRTY(WIDGET_DESCRIPTION);
+}
+
+// =========== Startup ===========
+// The window and a first frame come up before anything is read from the SD card: fonts, settings and
+// descriptions are loaded by a background thread, which posts STARTUP_LOADED_EVENT when it is done.
+// Controllers are opened as SDL reports them.
+
+#define STARTUP_LOADED_EVENT SDL_USEREVENT
+
+typedef struct
+{
+    TTF_Font *font;
+    TTF_Font *fontsm;
+    int status; // 0 when everything was loaded
+    double fonts_ms;
+    double settings_ms;
+    double descriptions_ms;
+} StartupLoad;
+
+Uint64 startup_counter;
+
+// Milliseconds since main() started
+double startup_ms()
+{
+    return (SDL_GetPerformanceCounter() - startup_counter) * 1000.0 / SDL_GetPerformanceFrequency();
+}
+
+int load_startup(void *data)
+{
+    StartupLoad *load = data;
+    double start = startup_ms();
 
     if (TTF_Init() == -1)
     {
         SDL_Log("Unable to initialize SDL_ttf: %s", TTF_GetError());
-        SDL_Quit();
-        return 1;
+        load->status = -1;
+    }
+    else
+    {
+        load->font = TTF_OpenFont("/mnt/SDCARD/System/resources/DejaVuSans.ttf", 40);   // Specify your font path
+        load->fontsm = TTF_OpenFont("/mnt/SDCARD/System/resources/DejaVuSans.ttf", 36); // Specify your font path
+        if (!load->font || !load->fontsm)
+        {
+            SDL_Log("Unable to open font: %s", TTF_GetError());
+            load->status = -1;
+        }
+    }
+    load->fonts_ms = startup_ms() - start;
+
+    // Read initial settings
+    start = startup_ms();
+    if (load->status == 0 && read_settings("led_daemon.conf", lights, NUM_OPTIONS) != 0)
+    {
+        load->status = -1;
+    }
+    if (load->status == 0)
+    {
+        load_settings_snapshot("led_daemon.conf");
+    }
+    load->settings_ms = startup_ms() - start;
+
+    start = startup_ms();
+    if (load->status == 0)
+    {
+        load_effect_descriptions();
     }
+    load->descriptions_ms = startup_ms() - start;
+
+    SDL_Event event = {.type = STARTUP_LOADED_EVENT};
+    SDL_PushEvent(&event);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    startup_counter = SDL_GetPerformanceCounter();
 
-    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER) < 0)
+    if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         SDL_Log("Unable to initialize SDL: %s", SDL_GetError());
         return 1;
     }
+    double sdl_init_ms = startup_ms();
+
+    // Fonts, settings and descriptions load while the window comes up
+    StartupLoad load = {0};
+    SDL_Thread *loader = SDL_CreateThread(load_startup, "startup", &load);
+    if (!loader)
+    {
+        SDL_Log("Unable to start the loader thread: %s", SDL_GetError());
+        load_startup(&load);
+    }
 
     SDL_Window *window = SDL_CreateWindow("Options Example",
                                           SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
@@ -444,58 +1320,40 @@ int main(int argc, char *argv[])
     if (!window)
     {
         SDL_Log("Unable to create window: %s", SDL_GetError());
+        SDL_WaitThread(loader, NULL);
         SDL_Quit();
         return 1;
     }
 
-    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
+    SDL_Renderer *renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC | SDL_RENDERER_TARGETTEXTURE);
     if (!renderer)
     {
         SDL_Log("Unable to create renderer: %s", SDL_GetError());
         SDL_DestroyWindow(window);
+        SDL_WaitThread(loader, NULL);
         SDL_Quit();
         return 1;
     }
+    double window_ms = startup_ms();
 
-    TTF_Font *font = TTF_OpenFont("/mnt/SDCARD/System/resources/DejaVuSans.ttf", 40);   // Specify your font path
-    TTF_Font *fontsm = TTF_OpenFont("/mnt/SDCARD/System/resources/DejaVuSans.ttf", 36); // Specify your font path
-    if (!font || !fontsm)
-    {
-        SDL_Log("Unable to open font: %s", TTF_GetError());
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        SDL_Quit();
-        return 1;
-    }
+    TTF_Font *font = NULL;
+    TTF_Font *fontsm = NULL;
+    bool loaded = false;
+    int exit_code = 0;
 
-    // Read initial settings
-    if (read_settings("led_daemon.conf", lights, NUM_OPTIONS) != 0)
+    shared_settings = ledshm_settings_open(1);
+    if (!shared_settings)
     {
-        TTF_CloseFont(font);
-        SDL_DestroyRenderer(renderer);
-        SDL_DestroyWindow(window);
-        TTF_Quit();
-        SDL_Quit();
-        return 1;
-    }
-
-    SDL_GameController *controller = NULL;
-    for (int i = 0; i < SDL_NumJoysticks(); ++i)
-    {
-        if (SDL_IsGameController(i))
-        {
-            controller = SDL_GameControllerOpen(i);
-            if (controller)
-            {
-                SDL_Log("Game Controller %s connected", SDL_GameControllerName(controller));
-                break;
-            }
-        }
+        SDL_Log("Unable to open shared settings, lcdaemon will only see saved changes");
     }
 
-    if (!controller)
+    // The segment outlives the UI, so it still holds what the previous session published
+    SharedLightSettings cached_lights[LEDSHM_MAX_LIGHTS];
+    int cached_light_count = 0;
+    if (shared_settings)
     {
-        SDL_Log("No game controller available");
+        uint32_t seq = UINT32_MAX; // Odd, never the sequence of a complete write
+        cached_light_count = ledshm_settings_read(shared_settings, cached_lights, NUM_OPTIONS, &seq);
     }
 
     int selected_light = 0;
@@ -503,48 +1361,115 @@ int main(int argc, char *argv[])
     bool running = true;
     SDL_Event event;
 
-    SDL_Color hex_to_sdl_color(uint32_t hex)
+    // Get the window size
+    int window_width, window_height;
+    SDL_GetWindowSize(window, &window_width, &window_height);
+
+    // Everything is drawn into the canvas, which keeps the widgets that did not change
+    SDL_Texture *canvas = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET, window_width, window_height);
+    if (!canvas)
     {
-        SDL_Color color;
-        color.r = (hex >> 16) & 0xFF;
-        color.g = (hex >> 8) & 0xFF;
-        color.b = hex & 0xFF;
-        color.a = 255;
-        return color;
+        SDL_Log("No render target support, redrawing the whole screen: %s", SDL_GetError());
+    }
+    else
+    {
+        SDL_SetRenderTarget(renderer, canvas);
     }
-
     SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
     SDL_RenderClear(renderer);
-    // Get the window size
-    int window_width, window_height;
-    SDL_GetWindowSize(window, &window_width, &window_height);
+
+    SDL_GameController *controller = NULL;
+    bool first_frame_shown = false;
+
+    Uint64 frame_time_total = 0;
+    unsigned long frame_count = 0;
+    Uint32 stats_since = SDL_GetTicks();
+    int shown_mainui_brightness = 0;
+
     while (running)
     {
+        // Block until something happens, except for the timers which are pending
+        int timeout = -1;
+        if (settings_store.dirty)
+        {
+            Uint32 since_change = SDL_GetTicks() - settings_store.changed_at;
+            timeout = since_change < SETTINGS_SAVE_DEBOUNCE_MS ? SETTINGS_SAVE_DEBOUNCE_MS - since_change : 0;
+        }
+        if (loaded && lights[selected_light].brightness == -1 && (timeout < 0 || timeout > 5000))
+        {
+            timeout = 5000; // MainUI brightness is refreshed every 5 seconds
+        }
+        if (timeout < 0 || timeout > preview_timeout())
+        {
+            timeout = preview_timeout();
+        }
 
-        if (SDL_WaitEventTimeout(&event, 50))
+        bool has_event;
+        if (dirty_widgets)
+            has_event = SDL_PollEvent(&event);
+        else if (timeout < 0)
+            has_event = SDL_WaitEvent(&event);
+        else
+            has_event = SDL_WaitEventTimeout(&event, timeout);
+
+        if (has_event)
         {
             do
             {
                 if (event.type == SDL_QUIT)
                 {
-                    running = false;
+                    running = false; // Also sent by SDL on SIGTERM
+                }
+                else if (event.type == STARTUP_LOADED_EVENT)
+                {
+                    SDL_WaitThread(loader, NULL);
+                    loader = NULL;
+                    if (load.status != 0)
+                    {
+                        running = false;
+                        exit_code = 1;
+                        break;
+                    }
+                    font = load.font;
+                    fontsm = load.fontsm;
+                    loaded = true;
+                    publish_settings(lights, NUM_OPTIONS);
+                    shown_mainui_brightness = get_mainui_brightness();
+                    dirty_widgets = DIRTY_ALL;
+                    SDL_Log("Startup: fonts %.1f ms, settings %.1f ms, descriptions %.1f ms, settings shown at %.1f ms",
+                            load.fonts_ms, load.settings_ms, load.descriptions_ms, startup_ms());
+                }
+                else if (event.type == SDL_CONTROLLERDEVICEADDED)
+                {
+                    if (controller == NULL && SDL_IsGameController(event.cdevice.which))
+                    {
+                        controller = SDL_GameControllerOpen(event.cdevice.which);
+                        if (controller)
+                        {
+                            SDL_Log("Game Controller %s connected at %.1f ms", SDL_GameControllerName(controller), startup_ms());
+                        }
+                    }
+                }
+                else if (!loaded)
+                {
+                    continue; // Settings are still loading
                 }
                 else if (event.type == SDL_KEYDOWN)
                 {
                     switch (event.key.keysym.sym)
                     {
                     case SDLK_DOWN:
-                        selected_setting = (selected_setting + 1) % 6;
+                        select_setting(&selected_setting, (selected_setting + 1) % NUM_SETTINGS);
                         break;
                     case SDLK_UP:
-                        selected_setting = (selected_setting - 1 + 6) % 6;
+                        select_setting(&selected_setting, (selected_setting - 1 + NUM_SETTINGS) % NUM_SETTINGS);
                         break;
                     case SDLK_TAB:
-                        selected_light = (selected_light - 1 + NUM_OPTIONS) % NUM_OPTIONS;
+                        select_light(&selected_light, (selected_light - 1 + NUM_OPTIONS) % NUM_OPTIONS);
                         break;
                     case SDLK_RIGHT:
                     case SDLK_LEFT:
-                        handle_light_input(&lights[selected_light], &event, selected_setting);
+                        change_setting(&lights[selected_light], &event, selected_setting);
                         break;
                     case SDLK_RETURN:
                     case SDLK_KP_ENTER:
@@ -562,20 +1487,20 @@ int main(int argc, char *argv[])
                     switch (event.cbutton.button)
                     {
                     case SDL_CONTROLLER_BUTTON_DPAD_DOWN:
-                        selected_setting = (selected_setting + 1) % 6;
+                        select_setting(&selected_setting, (selected_setting + 1) % NUM_SETTINGS);
                         break;
                     case SDL_CONTROLLER_BUTTON_DPAD_UP:
-                        selected_setting = (selected_setting - 1 + 6) % 6;
+                        select_setting(&selected_setting, (selected_setting - 1 + NUM_SETTINGS) % NUM_SETTINGS);
                         break;
                     case SDL_CONTROLLER_BUTTON_LEFTSHOULDER:
-                        selected_light = (selected_light - 1 + NUM_OPTIONS) % NUM_OPTIONS;
+                        select_light(&selected_light, (selected_light - 1 + NUM_OPTIONS) % NUM_OPTIONS);
                         break;
                     case SDL_CONTROLLER_BUTTON_RIGHTSHOULDER:
-                        selected_light = (selected_light + 1) % NUM_OPTIONS;
+                        select_light(&selected_light, (selected_light + 1) % NUM_OPTIONS);
                         break;
                     case SDL_CONTROLLER_BUTTON_DPAD_RIGHT:
                     case SDL_CONTROLLER_BUTTON_DPAD_LEFT:
-                        handle_light_input(&lights[selected_light], &event, selected_setting);
+                        change_setting(&lights[selected_light], &event, selected_setting);
                         break;
                     case SDL_CONTROLLER_BUTTON_B:
                         // strcpy(last_button_pressed, "DPAD Down");
@@ -587,7 +1512,7 @@ int main(int argc, char *argv[])
                         //         lights[selected_light].duration);
                         break;
                     case SDL_CONTROLLER_BUTTON_A:
-                        SDL_Quit();
+                        running = false;
                         break;
                         // Add more cases for other buttons as needed
                     }
@@ -595,316 +1520,117 @@ int main(int argc, char *argv[])
             } while (SDL_PollEvent(&event));
         }
 
-        SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-        SDL_RenderClear(renderer);
-
-        SDL_Color color = {255, 255, 255, 255};        // Default white color
-        SDL_Color darkcolor = {32, 36, 32, 255};       // Default white color
-        SDL_Color highlight_color = {0, 0, 0, 255};    // Cyan color for the current setting
-        SDL_Color selected_color = {255, 255, 0, 255}; // Yellow color for the selected option
-
-        // Display light name
-        char light_name_text[256];
-        TTF_SetFontStyle(font, TTF_STYLE_BOLD);
-
-        // Générer le texte
-        snprintf(light_name_text, sizeof(light_name_text), "%s", lights[selected_light].friendlyname);
-        SDL_Surface *surface = TTF_RenderText_Blended(font, light_name_text, color);
-        SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, surface);
-
-        int text_width = surface->w;
-        int text_height = surface->h;
-        SDL_FreeSurface(surface);
-
-        // Centered coordinates for text
-        int center_x = (window_width - text_width) / 2;
-        int center_y = 30;
-
-        // Background rectangle: full width, height-adjusted
-        SDL_Rect bg_rect = {
-            .x = 0,
-            .y = center_y - 5,
-            .w = window_width,
-            .h = text_height + 10};
-        SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255); // Dark grey
-        SDL_RenderFillRect(renderer, &bg_rect);
-
-        // Display centered text
-        SDL_Rect dstrect = {
-            .x = center_x,
-            .y = center_y,
-            .w = text_width,
-            .h = text_height};
-        SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-        SDL_DestroyTexture(texture);
-
-        // Reset style
-        TTF_SetFontStyle(font, TTF_STYLE_NORMAL);
+        flush_settings(false);
 
-        // Display settings
-        const char *settings_labels[6] = {"Effect", "Color1", "Color2", "Speed", "Brightness", "Trigger"};
-        int settings_values[6] = {
-            lights[selected_light].effect,
-            lights[selected_light].color,
-            lights[selected_light].color2,
-            lights[selected_light].duration,
-            lights[selected_light].brightness,
-            lights[selected_light].trigger,
-        };
-
-        for (int j = 0; j < 6; ++j)
+        if (loaded && lights[selected_light].brightness == -1 && get_mainui_brightness() != shown_mainui_brightness)
         {
-            char setting_text[256];
-
-            SDL_Color bgcolor = (j == selected_setting) ? color : highlight_color;
-
-            if (j == 0)
-            { // Display effect name instead of number
-              // snprintf(setting_text, sizeof(setting_text), "%s: %s", settings_labels[j], selected_light == 3 ? lr_effect_names[settings_values[j] - 1] : selected_light == 2 ? topbar_effect_names[settings_values[j] - 1]
-              //                                                                                                                                                                : effect_names[settings_values[j] - 1]);
-
-                snprintf(setting_text, sizeof(setting_text), "%s: %s",
-                         settings_labels[j],
-                         effect_names[settings_values[j] - 1]);
-
-                // Render the effect name
-                SDL_Color current_color = (j == selected_setting) ? highlight_color : color;
-
-                surface = TTF_RenderText_Solid(font, setting_text, current_color);
-                texture = SDL_CreateTextureFromSurface(renderer, surface);
-
-                text_width = surface->w;
-                text_height = surface->h;
-
-                SDL_SetRenderDrawColor(renderer, bgcolor.r, bgcolor.g, bgcolor.b, 255);
-                SDL_Rect rect = {20, 112, text_width + 60, 68};
-                SDL_RenderFillRect(renderer, &rect);
-
-                SDL_FreeSurface(surface);
-
-                // Calculate centered position
-                dstrect = (SDL_Rect){50, 122, text_width, text_height};
-                SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-                SDL_DestroyTexture(texture);
-            }
-            else if (j < 3)
-            { // Display color as hex code
-                snprintf(setting_text, sizeof(setting_text), "%s:", settings_labels[j]);
-
-                // Render the "COLOR:" text
-                SDL_Color current_color = (j == selected_setting) ? highlight_color : color; // Highlight color if selected
-                surface = TTF_RenderText_Solid(font, setting_text, current_color);
-                texture = SDL_CreateTextureFromSurface(renderer, surface);
-
-                text_width = surface->w;
-                text_height = surface->h;
-                SDL_SetRenderDrawColor(renderer, bgcolor.r, bgcolor.g, bgcolor.b, 255);
-                // draw_rounded_rect(renderer, 20, 112 + j * 82, text_width + 130, 68, 30);
-                SDL_Rect rect = {20, 112 + j * 82, text_width + 130, 68};
-                SDL_RenderFillRect(renderer, &rect);
-
-                int cube_x = 30 + text_width + 30;
-                int cube_y = 118 + j * 82;
-                int cube_w = 56;
-                int cube_h = 56;
-                int corner_radius = 10;
-
-                // Step 1: draw the slightly larger black background
-                SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
-                draw_rounded_rect(renderer, cube_x - 1, cube_y - 1, cube_w + 2, cube_h + 2, corner_radius + 1);
-
-                // Step 2: Draw the coloured cube on top
-                SDL_Color color_cube = hex_to_sdl_color(settings_values[j]);
-                SDL_SetRenderDrawColor(renderer, color_cube.r, color_cube.g, color_cube.b, color_cube.a);
-                draw_rounded_rect(renderer, cube_x, cube_y, cube_w, cube_h, corner_radius);
-
-                SDL_FreeSurface(surface);
-
-                // Calculate text position
-                dstrect = (SDL_Rect){50, 122 + j * 82, text_width, text_height};
-                SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-                SDL_DestroyTexture(texture);
-            }
-            else if (j == 5)
-            { // Display effect name instead of number
-                snprintf(setting_text, sizeof(setting_text), "%s: %s", settings_labels[j], triggernames[settings_values[j] - 1]);
+            shown_mainui_brightness = get_mainui_brightness();
+            dirty_widgets |= DIRTY(WIDGET_ROW + 4);
+        }
 
-                SDL_Color current_color = (j == selected_setting) ? highlight_color : color;
+        if (poll_preview())
+        {
+            dirty_widgets |= DIRTY(WIDGET_PREVIEW);
+        }
 
-                surface = TTF_RenderText_Solid(font, setting_text, current_color);
-                texture = SDL_CreateTextureFromSurface(renderer, surface);
+        if (!dirty_widgets || !running)
+            continue;
 
-                text_width = surface->w;
-                text_height = surface->h;
-                SDL_SetRenderDrawColor(renderer, bgcolor.r, bgcolor.g, bgcolor.b, 255);
-                // draw_rounded_rect(renderer, 20, 112 + j * 82, text_width + 60, 68, 30);
-                SDL_Rect rect = {20, 112 + j * 82, text_width + 60, 68};
-                SDL_RenderFillRect(renderer, &rect);
-                SDL_FreeSurface(surface);
+        Uint64 frame_start = SDL_GetPerformanceCounter();
+        if (!canvas)
+        {
+            dirty_widgets = DIRTY_ALL;
+            SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+            SDL_RenderClear(renderer);
+        }
 
-                // Calculate centered position
-                dstrect = (SDL_Rect){50, 122 + j * 82, text_width, text_height};
+        // Until the loader is done the rows come from the cached settings, without text
+        if (loaded && (dirty_widgets & DIRTY(WIDGET_TITLE)))
+            draw_title(renderer, font, window_width, &lights[selected_light]);
+        for (int j = 0; j < NUM_SETTINGS; ++j)
+        {
+            if (!(dirty_widgets & DIRTY(WIDGET_ROW + j)))
+                continue;
+            if (loaded)
+                draw_setting_row(renderer, font, window_width, &lights[selected_light], j, j == selected_setting);
+            else if (selected_light < cached_light_count)
+                draw_cached_row(renderer, window_width, &cached_lights[selected_light], j, j == selected_setting);
+        }
+        if (dirty_widgets & DIRTY(WIDGET_FOOTER))
+            draw_footer(renderer, fontsm, window_width, window_height);
+        if (dirty_widgets & DIRTY(WIDGET_DESCRIPTION))
+            draw_description(renderer, fontsm, window_width, window_height, loaded ? &lights[selected_light] : NULL);
+        if (dirty_widgets & DIRTY(WIDGET_PREVIEW))
+            draw_preview(renderer, window_width, window_height);
+        dirty_widgets = 0;
+
+        if (canvas)
+        {
+            SDL_SetRenderTarget(renderer, NULL);
+            SDL_RenderCopy(renderer, canvas, NULL, NULL);
+        }
+        SDL_RenderPresent(renderer);
+        if (canvas)
+        {
+            SDL_SetRenderTarget(renderer, canvas);
+        }
 
-                SDL_RenderCopy(renderer, texture, NULL, &dstrect);
+        if (!first_frame_shown)
+        {
+            first_frame_shown = true;
+            SDL_Log("Startup: SDL init %.1f ms, window and renderer %.1f ms, first frame at %.1f ms",
+                    sdl_init_ms, window_ms - sdl_init_ms, startup_ms());
 
-                SDL_DestroyTexture(texture);
-            }
-            else
+            // Controllers are reported through SDL_CONTROLLERDEVICEADDED events
+            if (SDL_InitSubSystem(SDL_INIT_JOYSTICK | SDL_INIT_GAMECONTROLLER) < 0)
             {
-                if (j == 4 && settings_values[j] == -1)
-                {
-                    int brightness_from_ui = get_mainui_brightness();
-                    snprintf(setting_text, sizeof(setting_text), "%s: %d (MainUI)", settings_labels[j], brightness_from_ui);
-                }
-                else
-                {
-                    snprintf(setting_text, sizeof(setting_text), "%s: %d", settings_labels[j], settings_values[j]);
-                }
-
-                SDL_Color current_color = (j == selected_setting) ? highlight_color : color;
-
-                surface = TTF_RenderText_Solid(font, setting_text, current_color);
-                texture = SDL_CreateTextureFromSurface(renderer, surface);
-
-                text_width = surface->w;
-                text_height = surface->h;
-                SDL_SetRenderDrawColor(renderer, bgcolor.r, bgcolor.g, bgcolor.b, 255);
-                // draw_rounded_rect(renderer, 20, 112 + j * 82, text_width + 60, 68, 30);
-                SDL_Rect rect = {20, 112 + j * 82, text_width + 60, 68};
-                SDL_RenderFillRect(renderer, &rect);
-                SDL_FreeSurface(surface);
-
-                // Calculate centered position
-                dstrect = (SDL_Rect){50, 122 + j * 82, text_width, text_height};
-
-                SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-
-                SDL_DestroyTexture(texture);
+                SDL_Log("Unable to initialize game controllers: %s", SDL_GetError());
             }
         }
 
-        SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
-        // draw_rounded_rect(renderer, 20, window_height - 90, 330, 80, 40);
-        SDL_Rect rect = {20, window_height - 95, 350, 80};
-        SDL_RenderFillRect(renderer, &rect);
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        // draw_rounded_rect(renderer, 30, window_height - 80, 100, 60, 30);
-        rect = (SDL_Rect){30, window_height - 85, 100, 60};
-        SDL_RenderFillRect(renderer, &rect);
-        char button_text[256];
-        snprintf(button_text, sizeof(button_text), "L/R");
-        surface = TTF_RenderText_Solid(fontsm, button_text, darkcolor);
-        texture = SDL_CreateTextureFromSurface(renderer, surface);
-        text_width = surface->w;
-        text_height = surface->h;
-        // Calculate centered position
-        dstrect = (SDL_Rect){50, window_height - 76, text_width, text_height};
-        SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-        SDL_DestroyTexture(texture);
-        SDL_FreeSurface(surface);
-
-        snprintf(button_text, sizeof(button_text), "Light select");
-        surface = TTF_RenderText_Solid(fontsm, button_text, color);
-        texture = SDL_CreateTextureFromSurface(renderer, surface);
-        text_width = surface->w;
-        text_height = surface->h;
-        // Calculate centered position
-        dstrect = (SDL_Rect){140, window_height - 78, text_width, text_height};
-        SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-        SDL_DestroyTexture(texture);
-        SDL_FreeSurface(surface);
-
-        SDL_SetRenderDrawColor(renderer, 64, 64, 64, 255);
-        // draw_rounded_rect(renderer, window_width - 190, window_height - 90, 170, 80, 40);
-        // SDL_Rect rect = {window_width - 190, window_height - 90, 170, 80};
-        rect = (SDL_Rect){window_width - 190, window_height - 95, 170, 80};
-        SDL_RenderFillRect(renderer, &rect);
-        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-        // draw_rounded_rect(renderer, window_width - 180, window_height - 80, 60, 60, 30);
-        // SDL_Rect rect = {window_width - 180, window_height - 80, 60, 60};
-        rect = (SDL_Rect){window_width - 180, window_height - 85, 60, 60};
-
-        SDL_RenderFillRect(renderer, &rect);
+        // Report render cost every 5 seconds
+        frame_time_total += SDL_GetPerformanceCounter() - frame_start;
+        frame_count++;
+        if (SDL_GetTicks() - stats_since >= 5000)
+        {
+            Uint32 elapsed = SDL_GetTicks() - stats_since;
+            SDL_Log("UI: %.2f ms/frame over %lu frames, %.1f texture uploads/s, text cache %d KiB",
+                    frame_time_total * 1000.0 / SDL_GetPerformanceFrequency() / frame_count, frame_count,
+                    texture_uploads * 1000.0 / elapsed, text_cache_bytes / 1024);
+            frame_time_total = 0;
+            frame_count = 0;
+            texture_uploads = 0;
+            stats_since = SDL_GetTicks();
+        }
+    }
 
-        snprintf(button_text, sizeof(button_text), "B");
-        surface = TTF_RenderText_Solid(fontsm, button_text, darkcolor);
-        texture = SDL_CreateTextureFromSurface(renderer, surface);
-        text_width = surface->w;
-        text_height = surface->h;
-        // Calculate centered position
-        dstrect = (SDL_Rect){window_width - 160, window_height - 78, text_width, text_height};
-        SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-        SDL_DestroyTexture(texture);
-        SDL_FreeSurface(surface);
-
-        snprintf(button_text, sizeof(button_text), "Quit");
-        surface = TTF_RenderText_Solid(fontsm, button_text, color);
-        texture = SDL_CreateTextureFromSurface(renderer, surface);
-        text_width = surface->w;
-        text_height = surface->h;
-        // Calculate centered position
-        dstrect = (SDL_Rect){window_width - 110, window_height - 78, text_width, text_height};
-        SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-        SDL_DestroyTexture(texture);
-        SDL_FreeSurface(surface);
-
-        // snprintf(button_text, sizeof(button_text), "By Robin Morgan :D");
-        // surface = TTF_RenderText_Solid(fontsm, button_text, color);
-        // texture = SDL_CreateTextureFromSurface(renderer, surface);
-        // text_width = surface->w;
-        // text_height = surface->h;
-
-        // dstrect = (SDL_Rect){(window_width - text_width) / 2, 660, text_width, text_height};
-        // SDL_RenderCopy(renderer, texture, NULL, &dstrect);
-        // SDL_DestroyTexture(texture);
-        // SDL_FreeSurface(surface);
-
-        // =========== Display effect description ===========
-        int effect_index = lights[selected_light].effect - 1;
-        const char *effect_name = effect_names[effect_index];
-        char *description = read_effect_description(effect_name);
-
-        // Frame on right
-        int box_x = window_width / 2 + 20;
-        int box_y = 93;
-        int box_w = window_width / 2 - 60;
-        int box_h = window_height - 200;
-
-        SDL_Rect desc_box = {box_x, box_y, box_w, box_h};
-        SDL_SetRenderDrawColor(renderer, 32, 32, 32, 255);
-        SDL_RenderFillRect(renderer, &desc_box);
-
-        // Multiline text
-        int line_height = 36;
-        int max_lines = box_h / line_height;
-        char *line = strtok(description, "\n");
-        int line_num = 0;
-
-        while (line && line_num < max_lines)
-        {
-            SDL_Surface *line_surface = TTF_RenderText_Blended(fontsm, line, (SDL_Color){255, 255, 255, 255});
-            SDL_Texture *line_texture = SDL_CreateTextureFromSurface(renderer, line_surface);
-            SDL_Rect line_dst = {
-                .x = box_x + 10,
-                .y = box_y + 10 + line_num * line_height,
-                .w = line_surface->w,
-                .h = line_surface->h};
-            SDL_RenderCopy(renderer, line_texture, NULL, &line_dst);
-            SDL_DestroyTexture(line_texture);
-            SDL_FreeSurface(line_surface);
-            line = strtok(NULL, "\n");
-            line_num++;
-        }
-        // =========== End Displays the effect description ===========
+    if (loader)
+    {
+        SDL_WaitThread(loader, NULL); // Quit before the loader was done
+    }
 
-        SDL_RenderPresent(renderer);
-        usleep(50000);
+    if (canvas)
+    {
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_DestroyTexture(canvas);
     }
-    TTF_CloseFont(font);
+    clear_text_cache();
+    clear_shape_cache();
+    free(description_arena);
+
+    flush_settings(true);
+    SDL_Log("Settings: %d changes, %d written to SD card, %d coalesced, %d unchanged",
+            settings_store.changes, settings_store.writes,
+            settings_store.changes - settings_store.writes - settings_store.unchanged, settings_store.unchanged);
+    ledshm_settings_close(shared_settings);
+    ledshm_preview_close(preview);
+
+    TTF_CloseFont(load.font);
+    TTF_CloseFont(load.fontsm);
     SDL_DestroyRenderer(renderer);
     SDL_DestroyWindow(window);
     TTF_Quit();
     SDL_Quit();
 
-    return 0;
+    return exit_code;
 }